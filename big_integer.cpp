@@ -1,479 +1,3115 @@
 #include "big_integer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
 #include <stdexcept>
-
-typedef std::vector<uint32_t> digits;
-static constexpr uint64_t ONE_64 = 1;
-static constexpr uint64_t POW32 = ONE_64 + UINT32_MAX;
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef big_integer::limb limb;
+typedef big_integer::limb_vector digits;
+
+#ifdef BIG_INTEGER_64BIT_LIMBS
+__extension__ typedef unsigned __int128 double_limb;
+__extension__ typedef __int128 signed_double_limb;
+#else
+typedef uint64_t double_limb;
+typedef int64_t signed_double_limb;
+#endif
+
+static constexpr unsigned LIMB_BITS = sizeof(limb) * 8;
+static constexpr limb LIMB_MAX = ~limb(0);
+static constexpr limb LIMB_TOP_BIT = limb(1) << (LIMB_BITS - 1);
+static constexpr double_limb BASE = double_limb(1) << LIMB_BITS;
 
 template<typename T>
-uint32_t cast_to_uint32_t(T x) {
-  return static_cast<uint32_t>(x);
+limb cast_to_limb(T x) {
+  return static_cast<limb>(x);
 }
 
-digits mul_uint32_t(digits const& d, uint32_t x) {
-  uint64_t carry = 0;
-  digits new_data(d.size() + 1);
-  for (size_t i = 0; i < d.size(); i++) {
-    uint64_t tmp = uint64_t(d[i]) * x + carry;
-    new_data[i] = cast_to_uint32_t(tmp);
-    carry = tmp >> 32;
+/// Limb kernels
+//
+// The innermost loops come in several implementations: portable C++ that runs everywhere, and x86-64
+// versions using mulx/adcx/adox carry chains and AVX2/AVX-512 vectors. The best set the CPU supports
+// is bound once at startup and reached through kernels(); every set computes the same results.
+
+// Carry chains run over 64-bit words where the compiler has a 128-bit type, so on little-endian
+// targets 32-bit limbs are added two at a time: the chain is the bottleneck, not the memory traffic
+#if defined(__SIZEOF_INT128__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+typedef uint64_t word;
+__extension__ typedef unsigned __int128 double_word;
+#else
+typedef limb word;
+typedef double_limb double_word;
+#endif
+
+static constexpr size_t LIMBS_PER_WORD = sizeof(word) / sizeof(limb);
+static constexpr unsigned WORD_BITS = sizeof(word) * 8;
+
+// r[0, n) = a[0, n) + b[0, n) + carry, returns the carry out; r may be a or b
+limb add_nn_portable(limb* r, limb const* a, limb const* b, size_t n, limb carry) {
+  double_word c = carry;
+  size_t i = 0;
+  for (; i + LIMBS_PER_WORD <= n; i += LIMBS_PER_WORD) {
+    word x, y;
+    std::memcpy(&x, a + i, sizeof(word));
+    std::memcpy(&y, b + i, sizeof(word));
+    c += double_word(x) + y;
+    word z = word(c);
+    std::memcpy(r + i, &z, sizeof(word));
+    c >>= WORD_BITS;
   }
-  new_data[d.size()] = cast_to_uint32_t(carry);
-  return new_data;
+  for (; i < n; i++) {
+    c += double_word(a[i]) + b[i];
+    r[i] = cast_to_limb(c);
+    c >>= LIMB_BITS;
+  }
+  return cast_to_limb(c);
 }
 
-big_integer::big_integer() : data_(0), sgn_(false) {}
+// r[0, n) = a[0, n) - b[0, n) - borrow, returns the borrow out; r may be a or b
+limb sub_nn_portable(limb* r, limb const* a, limb const* b, size_t n, limb borrow) {
+  double_word c = 1 - borrow;
+  size_t i = 0;
+  for (; i + LIMBS_PER_WORD <= n; i += LIMBS_PER_WORD) {
+    word x, y;
+    std::memcpy(&x, a + i, sizeof(word));
+    std::memcpy(&y, b + i, sizeof(word));
+    c += double_word(x) + word(~y);
+    word z = word(c);
+    std::memcpy(r + i, &z, sizeof(word));
+    c >>= WORD_BITS;
+  }
+  for (; i < n; i++) {
+    c += double_word(a[i]) + limb(~b[i]);
+    r[i] = cast_to_limb(c);
+    c >>= LIMB_BITS;
+  }
+  return cast_to_limb(1 - c);
+}
 
-big_integer::big_integer(big_integer const& other) = default;
+// r[0, n) = a[0, n) * m + carry, returns the high limb; r may be a
+limb mul_limb_c(limb* r, limb const* a, size_t n, limb m, limb carry) {
+  for (size_t i = 0; i < n; i++) {
+    double_limb p = double_limb(a[i]) * m + carry;
+    r[i] = cast_to_limb(p);
+    carry = cast_to_limb(p >> LIMB_BITS);
+  }
+  return carry;
+}
 
-big_integer::big_integer(int a) : big_integer(static_cast<long>(a)) {}
+// r[0, n) += a[0, n) * m + carry, returns the limb to carry into r[n]
+limb addmul_limb_c(limb* r, limb const* a, size_t n, limb m, limb carry) {
+  for (size_t i = 0; i < n; i++) {
+    double_limb p = double_limb(a[i]) * m + r[i] + carry;
+    r[i] = cast_to_limb(p);
+    carry = cast_to_limb(p >> LIMB_BITS);
+  }
+  return carry;
+}
 
-big_integer::big_integer(unsigned a) : big_integer(static_cast<unsigned long>(a)) {}
+// r[0, n) -= a[0, n) * m + borrow, returns the limb to borrow from r[n]
+limb submul_limb_c(limb* r, limb const* a, size_t n, limb m, limb borrow) {
+  for (size_t i = 0; i < n; i++) {
+    double_limb p = double_limb(a[i]) * m + borrow;
+    limb lo = cast_to_limb(p);
+    borrow = cast_to_limb(p >> LIMB_BITS) + (r[i] < lo);
+    r[i] -= lo;
+  }
+  return borrow;
+}
 
-big_integer::big_integer(long a) : big_integer(static_cast<long long>(a)) {}
+// r[0, n) = a[0, n) << shift, returns the bits shifted out; 0 <= shift < LIMB_BITS.
+// Runs from the top down, so r may be a or overlap it from above
+limb shl_n_portable(limb* r, limb const* a, size_t n, unsigned shift) {
+  if (n == 0) {
+    return 0;
+  }
+  if (shift == 0) {
+    std::memmove(r, a, n * sizeof(limb));
+    return 0;
+  }
+  limb out = a[n - 1] >> (LIMB_BITS - shift);
+  for (size_t i = n - 1; i > 0; i--) {
+    r[i] = (a[i] << shift) | (a[i - 1] >> (LIMB_BITS - shift));
+  }
+  r[0] = a[0] << shift;
+  return out;
+}
 
-big_integer::big_integer(unsigned long a) : big_integer(static_cast<unsigned long long>(a)) {}
+// r[0, n) = a[0, n) >> shift; 0 <= shift < LIMB_BITS.
+// Runs from the bottom up, so r may be a or overlap it from below
+void shr_n_portable(limb* r, limb const* a, size_t n, unsigned shift) {
+  if (n == 0) {
+    return;
+  }
+  if (shift == 0) {
+    std::memmove(r, a, n * sizeof(limb));
+    return;
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    r[i] = (a[i] >> shift) | (a[i + 1] << (LIMB_BITS - shift));
+  }
+  r[n - 1] = a[n - 1] >> shift;
+}
+
+// r[0, n) = a[0, n) op b[0, n); r may be a or b
+template <typename Op>
+void bitwise_n_portable(limb* r, limb const* a, limb const* b, size_t n) {
+  Op op;
+  for (size_t i = 0; i < n; i++) {
+    r[i] = op(a[i], b[i]);
+  }
+}
 
-big_integer::big_integer(long long a) : sgn_(a < 0) {
-  push(cast_to_uint32_t(a));
-  push(cast_to_uint32_t(a >> 32));
+struct limb_kernels {
+  char const* name;
+  bool (*supported)();
+  limb (*add_nn)(limb* r, limb const* a, limb const* b, size_t n, limb carry);
+  limb (*sub_nn)(limb* r, limb const* a, limb const* b, size_t n, limb borrow);
+  limb (*mul_limb)(limb* r, limb const* a, size_t n, limb m);
+  limb (*addmul_limb)(limb* r, limb const* a, size_t n, limb m);
+  limb (*submul_limb)(limb* r, limb const* a, size_t n, limb m);
+  limb (*shl_n)(limb* r, limb const* a, size_t n, unsigned shift);
+  void (*shr_n)(limb* r, limb const* a, size_t n, unsigned shift);
+  void (*and_n)(limb* r, limb const* a, limb const* b, size_t n);
+  void (*or_n)(limb* r, limb const* a, limb const* b, size_t n);
+  void (*xor_n)(limb* r, limb const* a, limb const* b, size_t n);
+};
+
+bool always_supported() {
+  return true;
 }
 
-big_integer::big_integer(unsigned long long a) : sgn_(false) {
-  while (a != 0) {
-    push(cast_to_uint32_t(a));
-    a >>= 32;
+limb mul_limb_portable(limb* r, limb const* a, size_t n, limb m) {
+  return mul_limb_c(r, a, n, m, 0);
+}
+
+limb addmul_limb_portable(limb* r, limb const* a, size_t n, limb m) {
+  return addmul_limb_c(r, a, n, m, 0);
+}
+
+limb submul_limb_portable(limb* r, limb const* a, size_t n, limb m) {
+  return submul_limb_c(r, a, n, m, 0);
+}
+
+static constexpr limb_kernels KERNELS_PORTABLE = {
+    "portable", always_supported, add_nn_portable, sub_nn_portable, mul_limb_portable, addmul_limb_portable,
+    submul_limb_portable,
+    shl_n_portable, shr_n_portable, bitwise_n_portable<std::bit_and<limb>>, bitwise_n_portable<std::bit_or<limb>>,
+    bitwise_n_portable<std::bit_xor<limb>>};
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(BIG_INTEGER_NO_CPU_DISPATCH)
+#define BIG_INTEGER_CPU_DISPATCH
+
+static_assert(sizeof(word) == 8, "the x86-64 kernels work on 64-bit words");
+
+// The carry-chain kernels below work on 64-bit words; with 32-bit limbs a word is a pair of limbs
+// and the odd limbs at the end go through the portable code. Loops that keep two carry chains in
+// CF and OF count a negative index up to zero with jrcxz, because inc/dec would clobber OF.
+
+limb add_nn_adx(limb* r, limb const* a, limb const* b, size_t n, limb carry) {
+  size_t blocks = n / LIMBS_PER_WORD / 4, done = blocks * 4 * LIMBS_PER_WORD;
+  if (blocks != 0) {
+    word c = carry, t0, t1;
+    size_t i = 0;
+    __asm__ volatile(
+        "neg %[c]\n\t"
+        "1:\n\t"
+        "mov (%[a],%[i],8), %[t0]\n\t"
+        "mov 8(%[a],%[i],8), %[t1]\n\t"
+        "adc (%[b],%[i],8), %[t0]\n\t"
+        "adc 8(%[b],%[i],8), %[t1]\n\t"
+        "mov %[t0], (%[r],%[i],8)\n\t"
+        "mov %[t1], 8(%[r],%[i],8)\n\t"
+        "mov 16(%[a],%[i],8), %[t0]\n\t"
+        "mov 24(%[a],%[i],8), %[t1]\n\t"
+        "adc 16(%[b],%[i],8), %[t0]\n\t"
+        "adc 24(%[b],%[i],8), %[t1]\n\t"
+        "mov %[t0], 16(%[r],%[i],8)\n\t"
+        "mov %[t1], 24(%[r],%[i],8)\n\t"
+        "lea 4(%[i]), %[i]\n\t"
+        "dec %[k]\n\t"
+        "jnz 1b\n\t"
+        "setc %b[c]\n\t"
+        "movzbl %b[c], %k[c]\n\t"
+        : [c] "+&r"(c), [i] "+&r"(i), [k] "+&r"(blocks), [t0] "=&r"(t0), [t1] "=&r"(t1)
+        : [r] "r"(r), [a] "r"(a), [b] "r"(b)
+        : "cc", "memory");
+    carry = cast_to_limb(c);
   }
+  return add_nn_portable(r + done, a + done, b + done, n - done, carry);
 }
 
-big_integer::big_integer(std::string const& str) : big_integer() {
-  bool tmp_sgn = str[0] == '-';
-  if (str.substr(tmp_sgn).empty()) {
-    throw std::invalid_argument("Can't parse empty string to big_integer");
+limb sub_nn_adx(limb* r, limb const* a, limb const* b, size_t n, limb borrow) {
+  size_t blocks = n / LIMBS_PER_WORD / 4, done = blocks * 4 * LIMBS_PER_WORD;
+  if (blocks != 0) {
+    word c = borrow, t0, t1;
+    size_t i = 0;
+    __asm__ volatile(
+        "neg %[c]\n\t"
+        "1:\n\t"
+        "mov (%[a],%[i],8), %[t0]\n\t"
+        "mov 8(%[a],%[i],8), %[t1]\n\t"
+        "sbb (%[b],%[i],8), %[t0]\n\t"
+        "sbb 8(%[b],%[i],8), %[t1]\n\t"
+        "mov %[t0], (%[r],%[i],8)\n\t"
+        "mov %[t1], 8(%[r],%[i],8)\n\t"
+        "mov 16(%[a],%[i],8), %[t0]\n\t"
+        "mov 24(%[a],%[i],8), %[t1]\n\t"
+        "sbb 16(%[b],%[i],8), %[t0]\n\t"
+        "sbb 24(%[b],%[i],8), %[t1]\n\t"
+        "mov %[t0], 16(%[r],%[i],8)\n\t"
+        "mov %[t1], 24(%[r],%[i],8)\n\t"
+        "lea 4(%[i]), %[i]\n\t"
+        "dec %[k]\n\t"
+        "jnz 1b\n\t"
+        "setc %b[c]\n\t"
+        "movzbl %b[c], %k[c]\n\t"
+        : [c] "+&r"(c), [i] "+&r"(i), [k] "+&r"(blocks), [t0] "=&r"(t0), [t1] "=&r"(t1)
+        : [r] "r"(r), [a] "r"(a), [b] "r"(b)
+        : "cc", "memory");
+    borrow = cast_to_limb(c);
   }
-  uint32_t tmp = 0, pow = 1;
-  uint32_t MAX_TMP = (UINT32_MAX - 9) / 10, MAX_POW = UINT32_MAX / 10;
-  for (size_t i = tmp_sgn; i < str.length(); i++) {
-    if (!(str[i] >= '0' && str[i] <= '9')) {
-      throw std::invalid_argument("Error while parsing number");
-    }
-    tmp = tmp * 10 + (str[i] - '0');
-    pow *= 10;
-    if (tmp > MAX_TMP || pow > MAX_POW) {
-      *this *= pow;
-      if (tmp_sgn) {
-        *this -= tmp;
-      } else {
-        *this += tmp;
-      }
-      tmp = 0;
-      pow = 1;
-    }
+  return sub_nn_portable(r + done, a + done, b + done, n - done, borrow);
+}
+
+// r = a * m over 2k words: one adc chain adds each high half to the next low half
+__attribute__((target("bmi2"))) limb mul_limb_adx(limb* r, limb const* a, size_t n, limb m) {
+  size_t done = n / LIMBS_PER_WORD / 2 * 2 * LIMBS_PER_WORD;
+  word hi = 0;
+  if (done != 0) {
+    word l0, h0, l1, h1;
+    long i = -long(done / LIMBS_PER_WORD);
+    __asm__ volatile(
+        "xor %k[l0], %k[l0]\n\t"
+        "1:\n\t"
+        "mulx (%[a],%[i],8), %[l0], %[h0]\n\t"
+        "mulx 8(%[a],%[i],8), %[l1], %[h1]\n\t"
+        "adc %[hi], %[l0]\n\t"
+        "mov %[l0], (%[r],%[i],8)\n\t"
+        "adc %[h0], %[l1]\n\t"
+        "mov %[l1], 8(%[r],%[i],8)\n\t"
+        "mov %[h1], %[hi]\n\t"
+        "lea 2(%[i]), %[i]\n\t"
+        "jrcxz 2f\n\t"
+        "jmp 1b\n\t"
+        "2:\n\t"
+        "adc $0, %[hi]\n\t"
+        : [hi] "+&r"(hi), [i] "+&c"(i), [l0] "=&r"(l0), [h0] "=&r"(h0), [l1] "=&r"(l1), [h1] "=&r"(h1)
+        : [r] "r"(r + done), [a] "r"(a + done), "d"(word(m))
+        : "cc", "memory");
   }
-  if (tmp != 0 || pow > 1) {
-    *this *= pow;
-    if (tmp_sgn) {
-      *this -= tmp;
-    } else {
-      *this += tmp;
-    }
+  return mul_limb_c(r + done, a + done, n - done, m, cast_to_limb(hi));
+}
+
+// r += a * m over 2k words: low halves plus the previous high halves in the CF chain, plus r in the OF chain
+__attribute__((target("bmi2,adx"))) limb addmul_limb_adx(limb* r, limb const* a, size_t n, limb m) {
+  size_t done = n / LIMBS_PER_WORD / 2 * 2 * LIMBS_PER_WORD;
+  word hi = 0;
+  if (done != 0) {
+    word l0, h0, l1, h1, zero;
+    long i = -long(done / LIMBS_PER_WORD);
+    __asm__ volatile(
+        "xor %k[zero], %k[zero]\n\t"
+        "1:\n\t"
+        "mulx (%[a],%[i],8), %[l0], %[h0]\n\t"
+        "mulx 8(%[a],%[i],8), %[l1], %[h1]\n\t"
+        "adcx %[hi], %[l0]\n\t"
+        "adox (%[r],%[i],8), %[l0]\n\t"
+        "mov %[l0], (%[r],%[i],8)\n\t"
+        "adcx %[h0], %[l1]\n\t"
+        "adox 8(%[r],%[i],8), %[l1]\n\t"
+        "mov %[l1], 8(%[r],%[i],8)\n\t"
+        "mov %[h1], %[hi]\n\t"
+        "lea 2(%[i]), %[i]\n\t"
+        "jrcxz 2f\n\t"
+        "jmp 1b\n\t"
+        "2:\n\t"
+        "adcx %[zero], %[hi]\n\t"
+        "adox %[zero], %[hi]\n\t"
+        : [hi] "+&r"(hi), [i] "+&c"(i), [l0] "=&r"(l0), [h0] "=&r"(h0), [l1] "=&r"(l1), [h1] "=&r"(h1),
+          [zero] "=&r"(zero)
+        : [r] "r"(r + done), [a] "r"(a + done), "d"(word(m))
+        : "cc", "memory");
   }
+  return addmul_limb_c(r + done, a + done, n - done, m, cast_to_limb(hi));
 }
 
-big_integer::~big_integer() = default;
+// r -= a * m over 2k words: the CF chain builds the product words t as in addmul, the OF chain adds
+// ~t to r starting from OF = 1, so its final carry is 1 exactly when nothing has to be borrowed
+__attribute__((target("bmi2,adx"))) limb submul_limb_adx(limb* r, limb const* a, size_t n, limb m) {
+  size_t done = n / LIMBS_PER_WORD / 2 * 2 * LIMBS_PER_WORD;
+  word hi = 0;
+  if (done != 0) {
+    word l0, h0, l1, h1, zero, of;
+    long i = -long(done / LIMBS_PER_WORD);
+    __asm__ volatile(
+        "xor %k[zero], %k[zero]\n\t"
+        "xor %k[of], %k[of]\n\t"
+        "mov $0x80000000, %k[l0]\n\t"
+        "sub $1, %k[l0]\n\t" // OF = 1, CF = 0
+        "1:\n\t"
+        "mulx (%[a],%[i],8), %[l0], %[h0]\n\t"
+        "mulx 8(%[a],%[i],8), %[l1], %[h1]\n\t"
+        "adcx %[hi], %[l0]\n\t"
+        "not %[l0]\n\t"
+        "adox (%[r],%[i],8), %[l0]\n\t"
+        "mov %[l0], (%[r],%[i],8)\n\t"
+        "adcx %[h0], %[l1]\n\t"
+        "not %[l1]\n\t"
+        "adox 8(%[r],%[i],8), %[l1]\n\t"
+        "mov %[l1], 8(%[r],%[i],8)\n\t"
+        "mov %[h1], %[hi]\n\t"
+        "lea 2(%[i]), %[i]\n\t"
+        "jrcxz 2f\n\t"
+        "jmp 1b\n\t"
+        "2:\n\t"
+        "adcx %[zero], %[hi]\n\t"
+        "adox %[zero], %[of]\n\t"
+        : [hi] "+&r"(hi), [i] "+&c"(i), [l0] "=&r"(l0), [h0] "=&r"(h0), [l1] "=&r"(l1), [h1] "=&r"(h1),
+          [zero] "=&r"(zero), [of] "=&r"(of)
+        : [r] "r"(r + done), [a] "r"(a + done), "d"(word(m))
+        : "cc", "memory");
+    hi += 1 - of;
+  }
+  return submul_limb_c(r + done, a + done, n - done, m, cast_to_limb(hi));
+}
 
-big_integer& big_integer::operator=(big_integer const& other) = default;
+// Shifts and bitwise operations on GCC vector types; the wrappers below compile them for AVX2 and AVX-512
+typedef limb limb_x256 __attribute__((vector_size(32)));
+typedef limb limb_x512 __attribute__((vector_size(64)));
 
-big_integer& big_integer::operator+=(big_integer const& rhs) {
-  size_t new_size = std::max(size(), rhs.size()) + 1;
-  expand(new_size, get_zero());
-  uint64_t carry = 0;
-  for (size_t i = 0; i < new_size; i++) {
-    uint64_t tmp = carry + data_[i] + rhs[i];
-    data_[i] = cast_to_uint32_t(tmp);
-    carry = tmp >> 32;
-  }
-  sgn_ = data_.back() & (1 << 31);
-  return delete_leading_zeroes();
+template <typename V>
+__attribute__((always_inline)) inline limb shl_n_vector(limb* r, limb const* a, size_t n, unsigned shift) {
+  constexpr size_t L = sizeof(V) / sizeof(limb);
+  if (n == 0 || shift == 0) {
+    return shl_n_portable(r, a, n, shift);
+  }
+  limb out = a[n - 1] >> (LIMB_BITS - shift);
+  size_t i = n - 1;
+  for (; i >= L; i -= L) {
+    V x, y;
+    std::memcpy(&x, a + i - L + 1, sizeof(V));
+    std::memcpy(&y, a + i - L, sizeof(V));
+    V z = (x << shift) | (y >> (LIMB_BITS - shift));
+    std::memcpy(r + i - L + 1, &z, sizeof(V));
+  }
+  for (; i > 0; i--) {
+    r[i] = (a[i] << shift) | (a[i - 1] >> (LIMB_BITS - shift));
+  }
+  r[0] = a[0] << shift;
+  return out;
 }
 
-big_integer& big_integer::operator-=(big_integer const& rhs) {
-  size_t new_size = std::max(size(), rhs.size()) + 1;
-  expand(new_size, get_zero());
-  uint64_t carry = 1;
-  for (size_t i = 0; i < new_size; i++) {
-    uint64_t tmp = carry + data_[i] + ~rhs[i];
-    data_[i] = cast_to_uint32_t(tmp);
-    carry = tmp >> 32;
-  }
-  sgn_ = data_.back() & (1 << 31);
-  return delete_leading_zeroes();
+template <typename V>
+__attribute__((always_inline)) inline void shr_n_vector(limb* r, limb const* a, size_t n, unsigned shift) {
+  constexpr size_t L = sizeof(V) / sizeof(limb);
+  if (n == 0 || shift == 0) {
+    return shr_n_portable(r, a, n, shift);
+  }
+  size_t i = 0;
+  for (; i + L < n; i += L) {
+    V x, y;
+    std::memcpy(&x, a + i, sizeof(V));
+    std::memcpy(&y, a + i + 1, sizeof(V));
+    V z = (x >> shift) | (y << (LIMB_BITS - shift));
+    std::memcpy(r + i, &z, sizeof(V));
+  }
+  for (; i + 1 < n; i++) {
+    r[i] = (a[i] >> shift) | (a[i + 1] << (LIMB_BITS - shift));
+  }
+  r[n - 1] = a[n - 1] >> shift;
 }
 
-big_integer& big_integer::operator*=(big_integer const& rhs) {
-  if (eq_zero() || rhs.eq_zero()) return *this;
-  big_integer c = abs();
-  big_integer d = rhs.abs();
-  if (d.size() == 1) {
-    data_ = mul_uint32_t(c.data_, d[0]);
-  } else if (c.size() == 1) {
-    data_ = mul_uint32_t(d.data_, c[0]);
-  } else {
-    data_.clear();
-    expand(c.size() + d.size() + 1, 0);
-    for (size_t i = 0; i < c.size(); i++) {
-      uint64_t carry = 0;
-      for (size_t j = 0; j < d.size(); j++) {
-        uint64_t mul = (uint64_t) c[i] * d[j];
-        uint64_t tmp = carry + data_[i + j] + cast_to_uint32_t(mul);
-        data_[i + j] = cast_to_uint32_t(tmp);
-        carry = (tmp >> 32) + (mul >> 32);
-      }
-      data_[i + d.size()] += cast_to_uint32_t(carry);
+// Op is only a tag here: calling a functor would pass vectors across a non-inlined call
+template <typename V, typename Op>
+__attribute__((always_inline)) inline void bitwise_n_vector(limb* r, limb const* a, limb const* b, size_t n) {
+  constexpr size_t L = sizeof(V) / sizeof(limb);
+  size_t i = 0;
+  for (; i + L <= n; i += L) {
+    V x, y, z;
+    std::memcpy(&x, a + i, sizeof(V));
+    std::memcpy(&y, b + i, sizeof(V));
+    if (std::is_same<Op, std::bit_and<limb>>::value) {
+      z = x & y;
+    } else if (std::is_same<Op, std::bit_or<limb>>::value) {
+      z = x | y;
+    } else {
+      z = x ^ y;
     }
+    std::memcpy(r + i, &z, sizeof(V));
   }
-  sgn_ ^= rhs.sgn_;
-  return norm();
+  bitwise_n_portable<Op>(r + i, a + i, b + i, n - i);
 }
 
-void difference(digits& a, digits const& b, size_t x) {
-  uint64_t carry = 1;
-  for (size_t i = 0; i < b.size(); i++) {
-    uint64_t tmp = carry + a[i + x] + ~b[i];
-    a[i + x] = cast_to_uint32_t(tmp);
-    carry = tmp >> 32;
+#define BIG_INTEGER_VECTOR_KERNELS(NAME, TARGET, V)                                                            \
+  __attribute__((target(TARGET))) limb shl_n_##NAME(limb* r, limb const* a, size_t n, unsigned shift) {        \
+    return shl_n_vector<V>(r, a, n, shift);                                                                    \
+  }                                                                                                            \
+  __attribute__((target(TARGET))) void shr_n_##NAME(limb* r, limb const* a, size_t n, unsigned shift) {        \
+    shr_n_vector<V>(r, a, n, shift);                                                                           \
+  }                                                                                                            \
+  __attribute__((target(TARGET))) void and_n_##NAME(limb* r, limb const* a, limb const* b, size_t n) {         \
+    bitwise_n_vector<V, std::bit_and<limb>>(r, a, b, n);                                                       \
+  }                                                                                                            \
+  __attribute__((target(TARGET))) void or_n_##NAME(limb* r, limb const* a, limb const* b, size_t n) {          \
+    bitwise_n_vector<V, std::bit_or<limb>>(r, a, b, n);                                                        \
+  }                                                                                                            \
+  __attribute__((target(TARGET))) void xor_n_##NAME(limb* r, limb const* a, limb const* b, size_t n) {         \
+    bitwise_n_vector<V, std::bit_xor<limb>>(r, a, b, n);                                                       \
   }
+
+BIG_INTEGER_VECTOR_KERNELS(avx2, "avx2", limb_x256)
+BIG_INTEGER_VECTOR_KERNELS(avx512, "avx512f", limb_x512)
+
+#undef BIG_INTEGER_VECTOR_KERNELS
+
+bool adx_supported() {
+  return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
 }
 
-uint32_t trial(uint32_t const a, uint32_t const b, uint32_t const div) {
-  return cast_to_uint32_t(std::min(POW32, ((uint64_t(a) << 32) + b) / div));
+bool avx2_supported() {
+  return adx_supported() && __builtin_cpu_supports("avx2");
 }
 
-bool smaller(digits const& a, digits const& b, size_t x) {
-  for (size_t i = b.size() - 1; ; i--) {
-    if (a[i + x] != b[i]) {
-      return a[i + x] < b[i];
-    }
-    if (i == 0) {
-      break;
+bool avx512_supported() {
+  return avx2_supported() && __builtin_cpu_supports("avx512f");
+}
+
+// the vector sets keep the bmi2/adx carry chains, every CPU with AVX-512 and nearly every one with AVX2 has them
+static constexpr limb_kernels KERNELS_ADX = {
+    "bmi2_adx", adx_supported, add_nn_adx, sub_nn_adx, mul_limb_adx, addmul_limb_adx, submul_limb_adx,
+    shl_n_portable, shr_n_portable, bitwise_n_portable<std::bit_and<limb>>, bitwise_n_portable<std::bit_or<limb>>,
+    bitwise_n_portable<std::bit_xor<limb>>};
+
+static constexpr limb_kernels KERNELS_AVX2 = {
+    "avx2", avx2_supported, add_nn_adx, sub_nn_adx, mul_limb_adx, addmul_limb_adx, submul_limb_adx,
+    shl_n_avx2, shr_n_avx2, and_n_avx2, or_n_avx2, xor_n_avx2};
+
+static constexpr limb_kernels KERNELS_AVX512 = {
+    "avx512", avx512_supported, add_nn_adx, sub_nn_adx, mul_limb_adx, addmul_limb_adx, submul_limb_adx,
+    shl_n_avx512, shr_n_avx512, and_n_avx512, or_n_avx512, xor_n_avx512};
+#endif
+
+// from the most portable to the fastest
+static limb_kernels const* const ALL_KERNELS[] = {
+    &KERNELS_PORTABLE,
+#ifdef BIG_INTEGER_CPU_DISPATCH
+    &KERNELS_ADX,
+    &KERNELS_AVX2,
+    &KERNELS_AVX512,
+#endif
+};
+
+// constant-initialized, so static initializers that run before the selection below use the portable kernels
+static std::atomic<limb_kernels const*> active_kernels{&KERNELS_PORTABLE};
+
+limb_kernels const& kernels() {
+  return *active_kernels.load(std::memory_order_relaxed);
+}
+
+limb_kernels const* find_kernels(std::string const& name) {
+  for (limb_kernels const* k : ALL_KERNELS) {
+    if (name == k->name && k->supported()) {
+      return k;
     }
   }
-  return false;
+  return nullptr;
 }
 
-big_integer& big_integer::operator/=(big_integer const& rhs) {
-  if (rhs.eq_zero()) {
-    throw std::invalid_argument("Error while evaluating a / b: division by zero");
+// The fastest supported set, unless BIG_INTEGER_KERNELS names another one
+limb_kernels const* default_kernels() {
+  char const* forced = std::getenv("BIG_INTEGER_KERNELS");
+  if (forced != nullptr && find_kernels(forced) != nullptr) {
+    return find_kernels(forced);
   }
-  big_integer c = abs();
-  big_integer d = rhs.abs();
-  if (c < d) {
-    data_.clear();
-    sgn_ = false;
-    return *this;
+  limb_kernels const* best = &KERNELS_PORTABLE;
+  for (limb_kernels const* k : ALL_KERNELS) {
+    if (k->supported()) {
+      best = k;
+    }
   }
-  if (d.size() == 1) {
-    data_ = c.div_uint32_t(d[0]);
-  } else {
-    digits x = c.data_, y = d.data_, dq;
-    uint32_t f = cast_to_uint32_t(POW32 / (ONE_64 + y.back()));
-    size_t ys = y.size();
-    digits q = mul_uint32_t(x, f), r = mul_uint32_t(y, f);
-    while (!q.empty() && q.back() == 0) q.pop_back();
-    while (!r.empty() && r.back() == 0) r.pop_back();
-    uint32_t div = r.back();
-    expand(x.size() - ys + 1, 0);
-    q.push_back(0);
-    for (size_t k = data_.size() - 1; ; k--) {
-      uint32_t qt = trial(q[k + ys], q[k + ys - 1], div);
-      dq = mul_uint32_t(r, qt);
-      while (smaller(q, dq, k)) {
-        qt--;
-        dq = mul_uint32_t(r, qt);
-      }
-      data_[k] = qt;
-      difference(q, dq, k);
-      if (k == 0) {
-        break;
-      }
+  return best;
+}
+
+static bool const kernels_selected = (active_kernels.store(default_kernels()), true);
+
+std::vector<std::string> big_integer_kernels::available() {
+  std::vector<std::string> names;
+  for (limb_kernels const* k : ALL_KERNELS) {
+    if (k->supported()) {
+      names.push_back(k->name);
     }
   }
-  sgn_ ^= rhs.sgn_;
-  return norm();
+  return names;
 }
 
+std::string big_integer_kernels::current() {
+  return kernels().name;
+}
 
-big_integer& big_integer::operator%=(big_integer const& rhs) {
-  return *this -= *this / rhs * rhs;
+bool big_integer_kernels::select(std::string const& name) {
+  limb_kernels const* k = find_kernels(name);
+  if (k == nullptr) {
+    return false;
+  }
+  active_kernels.store(k);
+  return true;
 }
 
-big_integer& big_integer::operator&=(big_integer const& rhs) {
-  return bit_operation(bit_and, rhs);
+void bitwise_n(std::bit_and<limb>, limb* r, limb const* a, limb const* b, size_t n) {
+  kernels().and_n(r, a, b, n);
 }
 
-big_integer& big_integer::operator|=(big_integer const& rhs) {
-  return bit_operation(bit_or, rhs);
+void bitwise_n(std::bit_or<limb>, limb* r, limb const* a, limb const* b, size_t n) {
+  kernels().or_n(r, a, b, n);
 }
 
-big_integer& big_integer::operator^=(big_integer const& rhs) {
-  return bit_operation(bit_xor, rhs);
+void bitwise_n(std::bit_xor<limb>, limb* r, limb const* a, limb const* b, size_t n) {
+  kernels().xor_n(r, a, b, n);
+}
+
+digits mul_limb(digits const& d, limb x) {
+  digits new_data(d.size() + 1);
+  new_data[d.size()] = kernels().mul_limb(new_data.data(), d.data(), d.size(), x);
+  return new_data;
+}
+
+#ifndef BIG_INTEGER_KARATSUBA_THRESHOLD
+#define BIG_INTEGER_KARATSUBA_THRESHOLD 32
+#endif
+
+// the squaring basecase does half the work of the general one, so it stays ahead for longer
+#ifndef BIG_INTEGER_SQR_KARATSUBA_THRESHOLD
+#define BIG_INTEGER_SQR_KARATSUBA_THRESHOLD 48
+#endif
+
+#ifndef BIG_INTEGER_TOOM3_THRESHOLD
+#define BIG_INTEGER_TOOM3_THRESHOLD 160
+#endif
+
+#ifndef BIG_INTEGER_NTT_THRESHOLD
+#ifdef BIG_INTEGER_64BIT_LIMBS
+#define BIG_INTEGER_NTT_THRESHOLD 640000
+#else
+#define BIG_INTEGER_NTT_THRESHOLD 120000
+#endif
+#endif
+
+#ifndef BIG_INTEGER_DIV_THRESHOLD
+#define BIG_INTEGER_DIV_THRESHOLD 48
+#endif
+
+static constexpr size_t KARATSUBA_THRESHOLD = BIG_INTEGER_KARATSUBA_THRESHOLD;
+static constexpr size_t SQR_KARATSUBA_THRESHOLD = BIG_INTEGER_SQR_KARATSUBA_THRESHOLD;
+static constexpr size_t TOOM3_THRESHOLD = BIG_INTEGER_TOOM3_THRESHOLD;
+static constexpr size_t NTT_THRESHOLD = BIG_INTEGER_NTT_THRESHOLD;
+static constexpr size_t DIV_THRESHOLD = BIG_INTEGER_DIV_THRESHOLD;
+
+/// Magnitudes: little-endian limb vectors, possibly with leading zeroes
+
+void trim(digits& a) {
+  while (!a.empty() && a.back() == 0) a.pop_back();
 }
 
-big_integer& big_integer::operator<<=(int rhs) {
-  if (rhs < 0) {
-    return operator>>=(-rhs);
+// r[0, n) = a[0, n) + b[0, m), n >= m; returns the carry out. Past b the carry usually dies
+// within a limb or two, after which the rest of a is copied, or left alone when r is a
+limb add_n(limb* r, limb const* a, size_t n, limb const* b, size_t m) {
+  limb carry = kernels().add_nn(r, a, b, m, 0);
+  size_t i = m;
+  for (; carry != 0 && i < n; i++) {
+    r[i] = a[i] + 1;
+    carry = r[i] == 0;
   }
-  digits new_data(rhs / 32, 0);
-  size_t mod = rhs % 32;
-  for (size_t i = 0; i <= size(); i++) {
-    uint32_t tmp = (operator[](i) << mod) & UINT32_MAX;
-    if (i > 0) tmp += (operator[](i - 1) >> (32 - mod));
-    new_data.push_back(tmp);
+  if (r != a) {
+    std::copy(a + i, a + n, r + i);
   }
-  data_ = new_data;
-  return delete_leading_zeroes();
+  return carry;
 }
 
-big_integer& big_integer::operator>>=(int rhs) {
-  if (rhs < 0) {
-    return operator<<=(-rhs);
+// r[0, n) = a[0, n) - b[0, m), n >= m; returns the borrow out
+limb sub_n(limb* r, limb const* a, size_t n, limb const* b, size_t m) {
+  limb borrow = kernels().sub_nn(r, a, b, m, 0);
+  size_t i = m;
+  for (; borrow != 0 && i < n; i++) {
+    borrow = a[i] == 0;
+    r[i] = a[i] - 1;
   }
-  digits new_data;
-  size_t mod = rhs % 32;
-  for (size_t i = rhs / 32; i < size(); i++) {
-    new_data.push_back((operator[](i) >> mod) + ((operator[](i + 1) << (32 - mod)) & UINT32_MAX));
+  if (r != a) {
+    std::copy(a + i, a + n, r + i);
   }
-  data_ = new_data;
-  return delete_leading_zeroes();
+  return borrow;
 }
 
-big_integer big_integer::operator+() const {
-  return *this;
+int compare_n(limb const* a, limb const* b, size_t n) {
+  for (size_t i = n; i-- > 0; ) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+  return 0;
 }
 
-big_integer big_integer::operator-() const {
-  if (eq_zero()) return *this;
-  return ~*this + 1;
+int compare_magnitude(digits const& a, digits const& b) {
+  if (a.size() != b.size()) {
+    return a.size() < b.size() ? -1 : 1;
+  }
+  return compare_n(a.data(), b.data(), a.size());
 }
 
-big_integer big_integer::operator~() const {
-  big_integer ans(*this);
-  ans.sgn_ ^= true;
-  for (uint32_t& i : ans.data_) {
-    i = ~i;
+digits add_magnitude(digits const& a, digits const& b) {
+  if (a.size() < b.size()) return add_magnitude(b, a);
+  digits r(a.size() + 1);
+  r[a.size()] = add_n(r.data(), a.data(), a.size(), b.data(), b.size());
+  trim(r);
+  return r;
+}
+
+// a >= b
+digits sub_magnitude(digits const& a, digits const& b) {
+  digits r(a.size());
+  sub_n(r.data(), a.data(), a.size(), b.data(), b.size());
+  trim(r);
+  return r;
+}
+
+// Adds a[0, n) to r starting at r[0], propagating the carry up to r[rn)
+void add_into(limb* r, size_t rn, limb const* a, size_t n) {
+  limb carry = add_n(r, r, n, a, n);
+  for (size_t i = n; carry != 0 && i < rn; i++) {
+    carry = ++r[i] == 0;
   }
-  return ans.delete_leading_zeroes();
 }
 
-big_integer& big_integer::operator++() {
-  *this += 1;
-  return *this;
+// Subtracts a[0, n) from r starting at r[0], propagating the borrow up to r[rn); returns the borrow out
+limb sub_from(limb* r, size_t rn, limb const* a, size_t n) {
+  limb borrow = sub_n(r, r, n, a, n);
+  for (size_t i = n; borrow != 0 && i < rn; i++) {
+    borrow = r[i]-- == 0;
+  }
+  return borrow;
 }
 
-big_integer big_integer::operator++(int) {
-  big_integer tmp(*this);
-  ++*this;
-  return tmp;
+// r[0, n) = B^n - r[0, n) for a non-zero r: the low zero limbs stay, the lowest non-zero one is negated and
+// the rest is inverted through the vectorized xor kernel
+void negate_n(limb* r, size_t n) {
+  static constexpr size_t BLOCK = 256;
+  static digits const ones(BLOCK, LIMB_MAX);
+  size_t i = 0;
+  while (r[i] == 0) {
+    i++;
+  }
+  r[i] = 0 - r[i];
+  for (i++; i < n; i += BLOCK) {
+    kernels().xor_n(r + i, r + i, ones.data(), std::min(BLOCK, n - i));
+  }
 }
 
-big_integer& big_integer::operator--() {
-  *this -= 1;
-  return *this;
+void mul_rec(limb* r, limb const* a, size_t an, limb const* b, size_t bn);
+
+// r[0, an + bn) = a * b
+void mul_basecase(limb* r, limb const* a, size_t an, limb const* b, size_t bn) {
+  limb_kernels const& k = kernels();
+  r[bn] = k.mul_limb(r, b, bn, a[0]);
+  for (size_t i = 1; i < an; i++) {
+    r[i + bn] = k.addmul_limb(r + i, b, bn, a[i]);
+  }
 }
 
-big_integer big_integer::operator--(int) {
-  big_integer tmp(*this);
-  --*this;
-  return tmp;
+void sqr_rec(limb* r, limb const* a, size_t n);
+
+// r[0, 2n) = a^2. Every cross product a_i * a_j, i < j, is computed once and doubled,
+// then the squares a_i^2 are added on the diagonal, so about n^2 / 2 limb products
+void sqr_basecase(limb* r, limb const* a, size_t n) {
+  limb_kernels const& k = kernels();
+  r[0] = 0;
+  r[2 * n - 1] = 0;
+  if (n > 1) {
+    r[n] = k.mul_limb(r + 1, a + 1, n - 1, a[0]);
+    for (size_t i = 1; i + 1 < n; i++) {
+      r[n + i] = k.addmul_limb(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+    r[2 * n - 1] = k.shl_n(r + 1, r + 1, 2 * n - 2, 1);
+  }
+  limb carry = 0;
+  for (size_t i = 0; i < n; i++) {
+    double_limb sq = double_limb(a[i]) * a[i];
+    double_limb lo = double_limb(r[2 * i]) + cast_to_limb(sq) + carry;
+    double_limb hi = double_limb(r[2 * i + 1]) + (sq >> LIMB_BITS) + (lo >> LIMB_BITS);
+    r[2 * i] = cast_to_limb(lo);
+    r[2 * i + 1] = cast_to_limb(hi);
+    carry = cast_to_limb(hi >> LIMB_BITS);
+  }
 }
 
-big_integer operator+(big_integer a, big_integer const& b) {
-  return a += b;
+// a = a1 * B^k + a0, b = b1 * B^k + b0,
+// a * b = z2 * B^2k + ((a0 + a1)(b0 + b1) - z2 - z0) * B^k + z0
+void mul_karatsuba(limb* r, limb const* a, size_t an, limb const* b, size_t bn) {
+  size_t k = (an + 1) / 2;
+  size_t ah = an - k, bh = bn - k;
+  mul_rec(r, a, k, b, k);
+  mul_rec(r + 2 * k, a + k, ah, b + k, bh);
+
+  digits sa(k + 1), sb(k + 1), t(2 * k + 2);
+  sa[k] = add_n(sa.data(), a, k, a + k, ah);
+  sb[k] = add_n(sb.data(), b, k, b + k, bh);
+  mul_rec(t.data(), sa.data(), k + 1, sb.data(), k + 1);
+  sub_n(t.data(), t.data(), t.size(), r, 2 * k);
+  sub_n(t.data(), t.data(), t.size(), r + 2 * k, ah + bh);
+
+  size_t tn = std::min(t.size(), an + bn - k);
+  add_into(r + k, an + bn - k, t.data(), tn);
 }
 
-big_integer operator-(big_integer a, big_integer const& b) {
-  return a -= b;
+// a = a1 * B^k + a0, a^2 = z2 * B^2k + (z2 + z0 - (a0 - a1)^2) * B^k + z0;
+// the difference keeps the middle square at k limbs, where a sum would need k + 1
+void sqr_karatsuba(limb* r, limb const* a, size_t n) {
+  size_t k = (n + 1) / 2;
+  size_t ah = n - k;
+  sqr_rec(r, a, k);
+  sqr_rec(r + 2 * k, a + k, ah);
+
+  limb const* hi = a + k;
+  bool a0_less = false;
+  if (std::all_of(a + ah, a + k, [](limb x) { return x == 0; })) {
+    size_t i = ah;
+    while (i-- > 0 && a[i] == hi[i]) {}
+    a0_less = i < ah && a[i] < hi[i];
+  }
+  digits d(a, a + k), t(2 * k), m(2 * k + 1);
+  if (a0_less) {
+    digits b(hi, hi + ah);
+    b.resize(k);
+    sub_n(d.data(), b.data(), k, a, k);
+  } else {
+    sub_n(d.data(), a, k, hi, ah);
+  }
+  sqr_rec(t.data(), d.data(), k);
+  m[2 * k] = add_n(m.data(), r, 2 * k, r + 2 * k, 2 * ah);
+  sub_n(m.data(), m.data(), m.size(), t.data(), t.size());
+
+  size_t mn = std::min(m.size(), 2 * n - k);
+  add_into(r + k, 2 * n - k, m.data(), mn);
 }
 
-big_integer operator*(big_integer a, big_integer const& b) {
-  return a *= b;
+struct signed_digits {
+  digits mag;
+  bool neg = false;
+};
+
+signed_digits operator+(signed_digits const& a, signed_digits const& b) {
+  if (a.neg == b.neg) {
+    return {add_magnitude(a.mag, b.mag), a.neg};
+  }
+  if (compare_magnitude(a.mag, b.mag) >= 0) {
+    digits r = sub_magnitude(a.mag, b.mag);
+    bool neg = a.neg && !r.empty();
+    return {std::move(r), neg};
+  }
+  return {sub_magnitude(b.mag, a.mag), b.neg};
 }
 
-big_integer operator/(big_integer a, big_integer const& b) {
-  return a /= b;
+signed_digits operator-(signed_digits const& a, signed_digits const& b) {
+  signed_digits nb = b;
+  nb.neg = !nb.neg && !nb.mag.empty();
+  return a + nb;
 }
 
-big_integer operator%(big_integer a, big_integer const& b) {
-  return a %= b;
+digits multiply(digits const& a, digits const& b);
+
+signed_digits operator*(signed_digits const& a, signed_digits const& b) {
+  digits r = multiply(a.mag, b.mag);
+  bool neg = a.neg != b.neg && !r.empty();
+  return {std::move(r), neg};
 }
 
-big_integer operator&(big_integer a, big_integer const& b) {
-  return a &= b;
+digits shl_magnitude(digits const& a, unsigned shift) {
+  digits r(a.size() + 1);
+  for (size_t i = 0; i < a.size(); i++) {
+    double_limb tmp = double_limb(a[i]) << shift;
+    r[i] |= cast_to_limb(tmp);
+    r[i + 1] = cast_to_limb(tmp >> LIMB_BITS);
+  }
+  trim(r);
+  return r;
 }
 
-big_integer operator|(big_integer a, big_integer const& b) {
-  return a |= b;
+// Exact division of a magnitude by a single limb
+void divexact_limb(digits& a, limb x) {
+  double_limb carry = 0;
+  for (size_t i = a.size(); i-- > 0; ) {
+    double_limb tmp = (carry << LIMB_BITS) + a[i];
+    a[i] = cast_to_limb(tmp / x);
+    carry = tmp % x;
+  }
+  trim(a);
 }
 
-big_integer operator^(big_integer a, big_integer const& b) {
-  return a ^= b;
+signed_digits piece(limb const* a, size_t an, size_t from, size_t len) {
+  if (from >= an) return {};
+  digits r(a + from, a + std::min(an, from + len));
+  trim(r);
+  return {std::move(r), false};
 }
 
-big_integer operator<<(big_integer a, int b) {
-  return a <<= b;
+// Toom-3 evaluation of a split into k-limb pieces at 0, 1, -1, -2 and inf
+void toom3_evaluate(limb const* a, size_t an, size_t k, signed_digits (&v)[5]) {
+  signed_digits a0 = piece(a, an, 0, k), a1 = piece(a, an, k, k), a2 = piece(a, an, 2 * k, k);
+  signed_digits p = a0 + a2;
+  v[1] = p + a1;
+  v[2] = p - a1;
+  v[3] = v[2] + a2;
+  v[3] = v[3] + v[3] - a0;
+  v[0] = std::move(a0);
+  v[4] = std::move(a2);
 }
 
-big_integer operator>>(big_integer a, int b) {
-  return a >>= b;
+// r[0, rn) from the products at 0, 1, -1, -2, inf with Bodrato's interpolation sequence
+void toom3_interpolate(limb* r, size_t rn, size_t k, signed_digits (&v)[5]) {
+  signed_digits& r0 = v[0];
+  signed_digits& r1 = v[1];
+  signed_digits& rm1 = v[2];
+  signed_digits& rm2 = v[3];
+  signed_digits& rinf = v[4];
+
+  signed_digits r3 = rm2 - r1;
+  divexact_limb(r3.mag, 3);
+  r1 = r1 - rm1;
+  divexact_limb(r1.mag, 2);
+  signed_digits r2 = rm1 - r0;
+  r3 = r2 - r3;
+  divexact_limb(r3.mag, 2);
+  r3 = r3 + signed_digits{shl_magnitude(rinf.mag, 1), false};
+  r2 = r2 + r1 - rinf;
+  r1 = r1 - r3;
+
+  std::fill(r, r + rn, 0);
+  signed_digits const* coefficients[] = {&r0, &r1, &r2, &r3, &rinf};
+  for (size_t i = 0; i < 5; i++) {
+    digits const& c = coefficients[i]->mag;
+    if (!c.empty()) {
+      add_into(r + i * k, rn - i * k, c.data(), c.size());
+    }
+  }
 }
 
-bool operator==(big_integer const& a, big_integer const& b) {
-  return a.sgn_ == b.sgn_ && a.data_ == b.data_;
+void mul_toom3(limb* r, limb const* a, size_t an, limb const* b, size_t bn) {
+  size_t k = (an + 2) / 3;
+  signed_digits va[5], vb[5];
+  toom3_evaluate(a, an, k, va);
+  toom3_evaluate(b, bn, k, vb);
+  for (size_t i = 0; i < 5; i++) {
+    va[i] = va[i] * vb[i];
+  }
+  toom3_interpolate(r, an + bn, k, va);
 }
 
-bool operator!=(big_integer const& a, big_integer const& b) {
-  return !(a == b);
+digits square(digits const& a);
+
+// Toom-3 with five squarings, all of them non-negative
+void sqr_toom3(limb* r, limb const* a, size_t n) {
+  size_t k = (n + 2) / 3;
+  signed_digits v[5];
+  toom3_evaluate(a, n, k, v);
+  for (signed_digits& x : v) {
+    x = {square(x.mag), false};
+  }
+  toom3_interpolate(r, 2 * n, k, v);
 }
 
-bool operator<(big_integer const& a, big_integer const& b) {
-  if (a.sgn_ != b.sgn_) {
-    return a.sgn_;
+/// Number-theoretic transform over three NTT-friendly primes, recombined by CRT (Garner)
+
+static constexpr uint32_t NTT_P1 = 469762049; // 7 * 2^26 + 1
+static constexpr uint32_t NTT_P2 = 167772161; // 5 * 2^25 + 1
+static constexpr uint32_t NTT_P3 = 754974721; // 45 * 2^24 + 1
+static constexpr size_t NTT_MAX_LENGTH = size_t(1) << 24;
+static constexpr size_t NTT_PIECES_PER_LIMB = LIMB_BITS / 32;
+
+// Transforms work on 32-bit pieces of the limbs regardless of the limb width
+typedef std::vector<uint32_t> pieces;
+
+constexpr uint32_t pow_mod_uint32_t(uint32_t a, uint64_t e, uint32_t p) {
+  uint64_t r = 1, x = a % p;
+  for (; e != 0; e >>= 1) {
+    if (e & 1) r = r * x % p;
+    x = x * x % p;
   }
-  if (a.size() != b.size()) {
-    return a.size() < b.size();
+  return uint32_t(r);
+}
+
+// Arithmetic modulo P in Montgomery form with R = 2^32
+template<uint32_t P>
+struct ntt_field {
+  static constexpr uint32_t neg_inv() {
+    uint32_t x = P;
+    for (int i = 0; i < 4; i++) x *= 2 - P * x;
+    return uint32_t(0) - x;
   }
-  for (size_t i = a.size() - 1; ; i--) {
-    if (a[i] != b[i]) {
-      return a[i] < b[i];
+
+  static constexpr uint32_t P_NEG_INV = neg_inv();
+  static constexpr uint32_t R2 = uint32_t((uint64_t(1) << 32) % P * ((uint64_t(1) << 32) % P) % P);
+
+  static uint32_t reduce(uint64_t t) {
+    uint32_t m = uint32_t(t) * P_NEG_INV;
+    uint32_t r = uint32_t((t + uint64_t(m) * P) >> 32);
+    return r >= P ? r - P : r;
+  }
+
+  static uint32_t mul(uint32_t a, uint32_t b) {
+    return reduce(uint64_t(a) * b);
+  }
+
+  static uint32_t to_mont(uint32_t a) {
+    return mul(a % P, R2);
+  }
+};
+
+// Roots w^j, j < len / 2, of order len in Montgomery form
+template<uint32_t P, uint32_t G>
+void ntt_roots(pieces& w, size_t len, bool invert) {
+  typedef ntt_field<P> field;
+  uint32_t wl = pow_mod_uint32_t(G, (P - 1) / len, P);
+  if (invert) wl = pow_mod_uint32_t(wl, P - 2, P);
+  wl = field::to_mont(wl);
+  w[0] = field::to_mont(1);
+  for (size_t i = 1; i < len / 2; i++) {
+    w[i] = field::mul(w[i - 1], wl);
+  }
+}
+
+// Decimation in frequency: natural order in, bit-reversed order out
+template<uint32_t P, uint32_t G>
+void ntt_forward(pieces& a) {
+  typedef ntt_field<P> field;
+  size_t n = a.size();
+  pieces w(n / 2);
+  for (size_t len = n; len >= 2; len >>= 1) {
+    ntt_roots<P, G>(w, len, false);
+    size_t half = len / 2;
+    for (size_t i = 0; i < n; i += len) {
+      uint32_t* x = a.data() + i;
+      uint32_t* y = x + half;
+      for (size_t j = 0; j < half; j++) {
+        uint32_t u = x[j], v = y[j];
+        x[j] = u + v < P ? u + v : u + v - P;
+        y[j] = field::mul(u >= v ? u - v : u + P - v, w[j]);
+      }
     }
-    if (i == 0) {
-      break;
+  }
+}
+
+// Decimation in time: bit-reversed order in, natural order out
+template<uint32_t P, uint32_t G>
+void ntt_inverse(pieces& a) {
+  typedef ntt_field<P> field;
+  size_t n = a.size();
+  pieces w(n / 2);
+  for (size_t len = 2; len <= n; len <<= 1) {
+    ntt_roots<P, G>(w, len, true);
+    size_t half = len / 2;
+    for (size_t i = 0; i < n; i += len) {
+      uint32_t* x = a.data() + i;
+      uint32_t* y = x + half;
+      for (size_t j = 0; j < half; j++) {
+        uint32_t u = x[j];
+        uint32_t v = field::mul(y[j], w[j]);
+        x[j] = u + v < P ? u + v : u + v - P;
+        y[j] = u >= v ? u - v : u + P - v;
+      }
     }
   }
-  return false;
 }
 
-bool operator>(big_integer const& a, big_integer const& b) {
-  return b < a;
+// Cyclic convolution of length n (a power of two) modulo P, in plain (non-Montgomery) form
+template<uint32_t P, uint32_t G>
+pieces ntt_convolve(pieces const& a, pieces const& b, size_t n) {
+  typedef ntt_field<P> field;
+  pieces fa(n);
+  for (size_t i = 0; i < a.size(); i++) fa[i] = field::to_mont(a[i]);
+  ntt_forward<P, G>(fa);
+  if (&a == &b) {
+    for (uint32_t& x : fa) x = field::mul(x, x);
+  } else {
+    pieces fb(n);
+    for (size_t i = 0; i < b.size(); i++) fb[i] = field::to_mont(b[i]);
+    ntt_forward<P, G>(fb);
+    for (size_t i = 0; i < n; i++) fa[i] = field::mul(fa[i], fb[i]);
+  }
+  ntt_inverse<P, G>(fa);
+  // leaving Montgomery form and dividing by n in one multiplication
+  uint32_t n_inv = pow_mod_uint32_t(uint32_t(n % P), P - 2, P);
+  for (uint32_t& x : fa) x = field::mul(x, n_inv);
+  return fa;
 }
 
-bool operator<=(big_integer const& a, big_integer const& b) {
-  return !(a > b);
+pieces to_pieces(limb const* a, size_t n) {
+  pieces r(n * NTT_PIECES_PER_LIMB);
+  for (size_t i = 0; i < r.size(); i++) {
+    r[i] = uint32_t(a[i / NTT_PIECES_PER_LIMB] >> (i % NTT_PIECES_PER_LIMB * 32));
+  }
+  return r;
 }
 
-bool operator>=(big_integer const& a, big_integer const& b) {
-  return !(a < b);
+// r[0, an + bn) = a * b; every convolution coefficient is below min(an, bn) * 2^64 < P1 * P2 * P3
+// (in 32-bit pieces), which the size checks in mul_rec guarantee
+void mul_ntt(limb* r, limb const* a, size_t an, limb const* b, size_t bn) {
+  pieces pa = to_pieces(a, an);
+  pieces pb = a == b && an == bn ? pieces() : to_pieces(b, bn);
+  pieces const& rb = pb.empty() ? pa : pb;
+  size_t rn = pa.size() + rb.size();
+  size_t n = 1;
+  while (n < rn - 1) n <<= 1;
+  pieces c1 = ntt_convolve<NTT_P1, 3>(pa, rb, n);
+  pieces c2 = ntt_convolve<NTT_P2, 3>(pa, rb, n);
+  pieces c3 = ntt_convolve<NTT_P3, 11>(pa, rb, n);
+
+  constexpr uint64_t p1_inv_p2 = pow_mod_uint32_t(NTT_P1, NTT_P2 - 2, NTT_P2);
+  constexpr uint64_t p1_inv_p3 = pow_mod_uint32_t(NTT_P1, NTT_P3 - 2, NTT_P3);
+  constexpr uint64_t p2_inv_p3 = pow_mod_uint32_t(NTT_P2, NTT_P3 - 2, NTT_P3);
+  constexpr uint64_t p1p2 = uint64_t(NTT_P1) * NTT_P2;
+
+  // 128-bit running carry kept as two 64-bit halves
+  uint64_t lo = 0, hi = 0;
+  std::fill(r, r + an + bn, 0);
+  for (size_t i = 0; i < rn; i++) {
+    if (i < rn - 1) {
+      uint64_t r1 = c1[i];
+      uint64_t t2 = (c2[i] + NTT_P2 - r1 % NTT_P2) * p1_inv_p2 % NTT_P2;
+      uint64_t t3 = (c3[i] + NTT_P3 - r1 % NTT_P3) * p1_inv_p3 % NTT_P3;
+      t3 = (t3 + NTT_P3 - t2) * p2_inv_p3 % NTT_P3;
+      // x = r1 + p1 * t2 + p1p2 * t3
+      uint64_t v = r1 + NTT_P1 * t2;
+      uint64_t m_lo = (p1p2 & UINT32_MAX) * t3;
+      uint64_t m_hi = (p1p2 >> 32) * t3;
+      lo += v;
+      hi += lo < v;
+      lo += m_lo;
+      hi += lo < m_lo;
+      uint64_t shifted = m_hi << 32;
+      lo += shifted;
+      hi += (lo < shifted) + (m_hi >> 32);
+    }
+    r[i / NTT_PIECES_PER_LIMB] |= limb(uint32_t(lo)) << (i % NTT_PIECES_PER_LIMB * 32);
+    lo = (lo >> 32) | (hi << 32);
+    hi >>= 32;
+  }
 }
 
-std::string to_string(big_integer const& a) {
-  if (a.data_.empty()) {
-    return a.sgn_ ? "-1" : "0";
+// r[0, an + bn) = a * b, selecting the algorithm by operand sizes
+void mul_rec(limb* r, limb const* a, size_t an, limb const* b, size_t bn) {
+  if (a == b && an == bn) {
+    sqr_rec(r, a, an);
+    return;
   }
-  std::string ans;
-  big_integer b = a.abs();
-  while (!b.eq_zero()) {
-    uint32_t tmp = (b % 1000000000)[0];
-    for (size_t i = 0; i < 9; i++) {
-      ans.push_back(char((tmp % 10) + '0'));
-      tmp /= 10;
-    }
-    b /= 1000000000;
+  if (an < bn) {
+    std::swap(a, b);
+    std::swap(an, bn);
   }
-  while (ans.length() > 0 && ans[ans.length() - 1] == '0') {
-    ans.pop_back();
+  if (bn < KARATSUBA_THRESHOLD) {
+    mul_basecase(r, a, an, b, bn);
+  } else if (bn >= NTT_THRESHOLD && (an + bn) * NTT_PIECES_PER_LIMB <= NTT_MAX_LENGTH
+             && bn * NTT_PIECES_PER_LIMB <= NTT_MAX_LENGTH / 8) {
+    mul_ntt(r, a, an, b, bn);
+  } else if (bn <= (an + 1) / 2) {
+    std::fill(r, r + an + bn, 0);
+    digits t(2 * bn);
+    for (size_t i = 0; i < an; i += bn) {
+      size_t len = std::min(bn, an - i);
+      mul_rec(t.data(), a + i, len, b, bn);
+      add_into(r + i, an + bn - i, t.data(), len + bn);
+    }
+  } else if (bn < TOOM3_THRESHOLD || bn <= 2 * ((an + 2) / 3)) {
+    mul_karatsuba(r, a, an, b, bn);
+  } else {
+    mul_toom3(r, a, an, b, bn);
   }
-  if (a.sgn_) {
-    ans.push_back('-');
+}
+
+// r[0, 2n) = a^2
+void sqr_rec(limb* r, limb const* a, size_t n) {
+  if (n < SQR_KARATSUBA_THRESHOLD) {
+    sqr_basecase(r, a, n);
+  } else if (n >= NTT_THRESHOLD && 2 * n * NTT_PIECES_PER_LIMB <= NTT_MAX_LENGTH
+             && n * NTT_PIECES_PER_LIMB <= NTT_MAX_LENGTH / 8) {
+    mul_ntt(r, a, n, a, n);
+  } else if (n < TOOM3_THRESHOLD) {
+    sqr_karatsuba(r, a, n);
+  } else {
+    sqr_toom3(r, a, n);
   }
-  std::reverse(ans.begin(), ans.end());
-  return ans;
 }
 
-std::ostream& operator<<(std::ostream& s, big_integer const& a) {
-  return s << to_string(a);
+digits square(digits const& a) {
+  if (a.empty()) return {};
+  digits r(2 * a.size());
+  sqr_rec(r.data(), a.data(), a.size());
+  trim(r);
+  return r;
 }
 
-size_t big_integer::size() const {
-  return data_.size();
+digits multiply(digits const& a, digits const& b) {
+  if (a.empty() || b.empty()) return {};
+  if (&a == &b || a == b) return square(a);
+  digits r(a.size() + b.size());
+  mul_rec(r.data(), a.data(), a.size(), b.data(), b.size());
+  trim(r);
+  return r;
 }
 
-/// Private
+big_integer::big_integer() : data_(0), sgn_(false) {}
 
-const std::function<uint32_t(uint32_t, uint32_t)> big_integer::bit_and = [](uint32_t a, uint32_t b) { return a & b; };
-const std::function<uint32_t(uint32_t, uint32_t)> big_integer::bit_or  = [](uint32_t a, uint32_t b) { return a | b; };
-const std::function<uint32_t(uint32_t, uint32_t)> big_integer::bit_xor = [](uint32_t a, uint32_t b) { return a ^ b; };
+big_integer::big_integer(big_integer const& other) = default;
 
-bool big_integer::eq_zero() const {
-  return data_.empty() && !sgn_;
+big_integer::big_integer(big_integer&& other) noexcept : data_(std::move(other.data_)), sgn_(other.sgn_) {
+  other.sgn_ = false;
 }
 
-uint32_t big_integer::operator[](size_t ind) const {
-  if (ind >= size()) return sgn_ ? UINT32_MAX : 0;
-  return data_[ind];
-}
+big_integer::big_integer(int a) : big_integer(static_cast<long>(a)) {}
 
-big_integer big_integer::abs() const {
-  return sgn_ ? -*this : *this;
-}
+big_integer::big_integer(unsigned a) : big_integer(static_cast<unsigned long>(a)) {}
 
-big_integer& big_integer::bit_operation(std::function<uint32_t(uint32_t, uint32_t)> const& f, big_integer const& b) {
-  digits new_data(std::max(size(), b.size()));
-  for (size_t i = 0; i < new_data.size(); i++) new_data[i] = f(operator[](i), b[i]);
-  data_ = new_data;
-  sgn_ = f(sgn_, b.sgn_);
-  delete_leading_zeroes();
-  return *this;
+big_integer::big_integer(long a) : big_integer(static_cast<long long>(a)) {}
+
+big_integer::big_integer(unsigned long a) : big_integer(static_cast<unsigned long long>(a)) {}
+
+big_integer::big_integer(long long a)
+    : big_integer(a < 0 ? 0 - static_cast<unsigned long long>(a) : static_cast<unsigned long long>(a)) {
+  sgn_ = a < 0;
 }
 
-big_integer& big_integer::delete_leading_zeroes() {
-  while (!data_.empty() && ((sgn_ && data_[size() - 1] == UINT32_MAX) || (!sgn_ && data_[size() - 1] == 0))) {
-    data_.pop_back();
+big_integer::big_integer(unsigned long long a) : sgn_(false) {
+  for (unsigned i = 0; i < 64; i += LIMB_BITS) {
+    data_.push_back(cast_to_limb(a >> i));
   }
-  return *this;
+  delete_leading_zeroes();
 }
 
-digits big_integer::div_uint32_t(uint32_t x) const {
-  uint64_t carry = 0;
-  digits new_data(size());
-  for (size_t i = size() - 1; ; i--) {
-    uint64_t tmp = (carry << 32) + operator[](i);
-    new_data[i] = cast_to_uint32_t(tmp / x);
-    carry = tmp % x;
-    if (i == 0) break;
+digits parse_decimal(char const* first, char const* last);
+
+big_integer::big_integer(std::string const& str) : big_integer() {
+  bool tmp_sgn = !str.empty() && str[0] == '-';
+  if (str.size() == size_t(tmp_sgn)) {
+    throw std::invalid_argument("Can't parse empty string to big_integer");
   }
-  return new_data;
+  data_ = parse_decimal(str.data() + tmp_sgn, str.data() + str.size());
+  sgn_ = tmp_sgn && !data_.empty();
 }
 
-big_integer& big_integer::norm() {
-  if (sgn_) {
-    uint64_t carry = 1, tmp = 0;
-    data_.resize(size() + 1);
-    for (size_t i = 0; i < size(); i++) {
-      tmp = carry + (~operator[](i));
-      data_[i] = cast_to_uint32_t(tmp);
-      carry = tmp >> 32;
-    }
+big_integer::~big_integer() = default;
+
+big_integer& big_integer::operator=(big_integer const& other) = default;
+
+big_integer& big_integer::operator=(big_integer&& other) noexcept {
+  data_ = std::move(other.data_);
+  sgn_ = other.sgn_;
+  if (this != &other) {
+    other.sgn_ = false;
   }
-  delete_leading_zeroes();
   return *this;
 }
 
-void big_integer::push(uint32_t x) {
-  if (sgn_ && x == UINT32_MAX || !sgn_ && x == 0) return;
-  data_.push_back(x);
+big_integer& big_integer::operator+=(big_integer const& rhs) {
+  return add_signed(rhs, rhs.sgn_);
 }
 
-uint32_t big_integer::get_zero() const {
-  return sgn_ ? UINT32_MAX : 0;
+big_integer& big_integer::operator-=(big_integer const& rhs) {
+  return add_signed(rhs, !rhs.sgn_);
 }
 
-void big_integer::expand(size_t x, uint32_t y) {
-  while (data_.size() > x) {
-    data_.pop_back();
-  }
-  while (data_.size() < x) {
-    data_.push_back(y);
-  }
-}
+big_integer& big_integer::operator*=(big_integer const& rhs) {
+  if (eq_zero() || rhs.eq_zero()) {
+    data_.clear();
+    sgn_ = false;
+    return *this;
+  }
+  if (this == &rhs || data_ == rhs.data_) {
+    // equal magnitudes, the sign still follows rhs: a * -a is negative
+    data_ = square(data_);
+    sgn_ = this != &rhs && sgn_ != rhs.sgn_;
+    return *this;
+  }
+  if (rhs.size() == 1) {
+    data_ = mul_limb(data_, rhs.data_[0]);
+  } else if (size() == 1) {
+    data_ = mul_limb(rhs.data_, data_[0]);
+  } else {
+    data_ = multiply(data_, rhs.data_);
+  }
+  sgn_ ^= rhs.sgn_;
+  return delete_leading_zeroes();
+}
+
+unsigned leading_zeroes(limb x) {
+  unsigned r = 0;
+  while (!(x & LIMB_TOP_BIT)) {
+    x <<= 1;
+    r++;
+  }
+  return r;
+}
+
+// Divides a magnitude by a single limb in place, returns the remainder
+limb divide_limb(digits& a, limb x) {
+  double_limb carry = 0;
+  for (size_t i = a.size(); i-- > 0; ) {
+    double_limb tmp = (carry << LIMB_BITS) + a[i];
+    a[i] = cast_to_limb(tmp / x);
+    carry = tmp % x;
+  }
+  trim(a);
+  return cast_to_limb(carry);
+}
+
+// a mod x for a single limb x
+limb mod_limb(digits const& a, limb x) {
+  double_limb rem = 0;
+  for (size_t i = a.size(); i-- > 0; ) {
+    rem = ((rem << LIMB_BITS) | a[i]) % x;
+  }
+  return cast_to_limb(rem);
+}
+
+// Knuth's algorithm D on raw limbs. v[0, n) is the divisor with its top bit set, n >= 2, u[0, m + n] the dividend
+// shifted by the same amount with one extra limb on top. Writes the quotient to q[0, m] and leaves the remainder
+// in u[0, n). Each step subtracts qhat * v from u in place and adds v back at most once
+void divide_knuth_n(limb* q, limb* u, size_t m, limb const* v, size_t n) {
+  limb v1 = v[n - 1], v2 = v[n - 2];
+  for (size_t j = m + 1; j-- > 0; ) {
+    double_limb num = (double_limb(u[j + n]) << LIMB_BITS) | u[j + n - 1];
+    double_limb qhat = num / v1;
+    double_limb rhat = num % v1;
+    while (qhat >= BASE || qhat * v2 > ((rhat << LIMB_BITS) | u[j + n - 2])) {
+      qhat--;
+      rhat += v1;
+      if (rhat >= BASE) break;
+    }
+    limb borrow = kernels().submul_limb(u + j, v, n, cast_to_limb(qhat));
+    limb top = u[j + n];
+    u[j + n] = top - borrow;
+    if (top < borrow) {
+      qhat--;
+      u[j + n] += add_n(u + j, u + j, n, v, n);
+    }
+    q[j] = cast_to_limb(qhat);
+  }
+}
+
+// q = a / b, r = a % b for magnitudes, b != 0. The normalized operands live in a per-thread workspace,
+// so apart from growing q and r this does not allocate once the workspace is large enough
+void divide_knuth(digits const& a, digits const& b, digits& q, digits& r) {
+  if (compare_magnitude(a, b) < 0) {
+    r = a;
+    q.clear();
+    return;
+  }
+  if (b.size() == 1) {
+    q = a;
+    limb rem = divide_limb(q, b[0]);
+    r.clear();
+    if (rem != 0) r.push_back(rem);
+    return;
+  }
+  size_t n = b.size(), m = a.size() - n;
+  unsigned shift = leading_zeroes(b.back());
+  thread_local digits workspace;
+  workspace.resize(a.size() + 1 + n);
+  limb* u = workspace.data();
+  limb* v = u + a.size() + 1;
+  kernels().shl_n(v, b.data(), n, shift);
+  u[a.size()] = kernels().shl_n(u, a.data(), a.size(), shift);
+
+  q.resize(m + 1);
+  divide_knuth_n(q.data(), u, m, v, n);
+  trim(q);
+  r.resize(n);
+  kernels().shr_n(r.data(), u, n, shift);
+  trim(r);
+}
+
+// a div B^k
+digits high_limbs(digits const& a, size_t k) {
+  if (a.size() <= k) return {};
+  return digits(a.data() + k, a.data() + a.size());
+}
+
+// a mod B^k
+digits low_limbs(digits const& a, size_t k) {
+  digits r(a.data(), a.data() + std::min(k, a.size()));
+  trim(r);
+  return r;
+}
+
+// a * B^k
+digits shift_limbs(digits const& a, size_t k) {
+  if (a.empty()) return {};
+  digits r(a.size() + k);
+  std::copy(a.begin(), a.end(), r.begin() + k);
+  return r;
+}
+
+digits shr_magnitude(digits const& a, unsigned shift) {
+  if (shift == 0) return a;
+  digits r(a.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    r[i] = a[i] >> shift;
+    if (i + 1 < a.size()) r[i] |= a[i + 1] << (LIMB_BITS - shift);
+  }
+  trim(r);
+  return r;
+}
+
+// q > 0
+void decrement(digits& q) {
+  for (size_t i = 0; q[i]-- == 0; i++) {}
+  trim(q);
+}
+
+void increment(digits& q) {
+  for (size_t i = 0; i < q.size(); i++) {
+    if (++q[i] != 0) return;
+  }
+  q.push_back(1);
+}
+
+// Recursive division (Modern Computer Arithmetic, algorithm 1.8) for a normalized b with n limbs
+// and a of at most 2n limbs: the quotient's halves come from dividing the top of a by the top of b
+// and are then corrected using the rest of b, which costs a few multiplications instead of a quadratic loop
+void divide_recursive(digits const& a, digits const& b, digits& q, digits& r) {
+  size_t n = b.size();
+  if (a.size() < n || a.size() - n < DIV_THRESHOLD || n < DIV_THRESHOLD) {
+    divide_knuth(a, b, q, r);
+    return;
+  }
+  size_t m = a.size() - n;
+  digits top = high_limbs(a, m);
+  if (compare_magnitude(top, b) >= 0) {
+    // b is normalized, so a < 2 * b * B^m and the leading quotient limb is 1
+    digits rest = add_magnitude(shift_limbs(sub_magnitude(top, b), m), low_limbs(a, m));
+    divide_recursive(rest, b, q, r);
+    q = add_magnitude(q, shift_limbs(digits(1, 1), m));
+    return;
+  }
+
+  size_t k = m / 2;
+  digits b1 = high_limbs(b, k), b0 = low_limbs(b, k);
+  digits q1, r1, q0, r0;
+
+  divide_recursive(high_limbs(a, 2 * k), b1, q1, r1);
+  digits x = add_magnitude(shift_limbs(r1, 2 * k), low_limbs(a, 2 * k));
+  digits t = shift_limbs(multiply(q1, b0), k);
+  if (compare_magnitude(x, t) < 0) {
+    digits bk = shift_limbs(b, k);
+    while (compare_magnitude(x, t) < 0) {
+      x = add_magnitude(x, bk);
+      decrement(q1);
+    }
+  }
+  x = sub_magnitude(x, t);
+
+  divide_recursive(high_limbs(x, k), b1, q0, r0);
+  x = add_magnitude(shift_limbs(r0, k), low_limbs(x, k));
+  t = multiply(q0, b0);
+  while (compare_magnitude(x, t) < 0) {
+    x = add_magnitude(x, b);
+    decrement(q0);
+  }
+  r = sub_magnitude(x, t);
+  q = add_magnitude(shift_limbs(q1, k), q0);
+}
+
+// q = a / b, r = a % b for magnitudes, b != 0
+void divide(digits const& a, digits const& b, digits& q, digits& r) {
+  size_t n = b.size();
+  if (n < DIV_THRESHOLD || a.size() < n + DIV_THRESHOLD) {
+    divide_knuth(a, b, q, r);
+    return;
+  }
+  unsigned shift = leading_zeroes(b.back());
+  digits nb = shift == 0 ? b : shl_magnitude(b, shift);
+  digits na = shift == 0 ? a : shl_magnitude(a, shift);
+
+  // long division with n-limb "digits", each step a recursive 2n by n division
+  size_t blocks = (na.size() - 1) / n;
+  digits rem = high_limbs(na, blocks * n), qj;
+  q.clear();
+  // only the first step can produce an (n + 1)-limb quotient, the top part of a may exceed b
+  q.resize(blocks * n + 1);
+  for (size_t j = blocks; j-- > 0; ) {
+    digits cur = add_magnitude(shift_limbs(rem, n), low_limbs(high_limbs(na, j * n), n));
+    divide_recursive(cur, nb, qj, rem);
+    std::copy(qj.begin(), qj.end(), q.begin() + j * n);
+  }
+  trim(q);
+  r = shr_magnitude(rem, shift);
+}
+
+big_integer& big_integer::operator/=(big_integer const& rhs) {
+  big_integer r;
+  divmod(*this, rhs, *this, r);
+  return *this;
+}
+
+big_integer& big_integer::operator%=(big_integer const& rhs) {
+  big_integer q;
+  divmod(*this, rhs, q, *this);
+  return *this;
+}
+
+big_integer& big_integer::operator&=(big_integer const& rhs) {
+  return bit_operation<std::bit_and<limb>>(rhs);
+}
+
+big_integer& big_integer::operator|=(big_integer const& rhs) {
+  return bit_operation<std::bit_or<limb>>(rhs);
+}
+
+big_integer& big_integer::operator^=(big_integer const& rhs) {
+  return bit_operation<std::bit_xor<limb>>(rhs);
+}
+
+big_integer big_integer::operator+() const {
+  return *this;
+}
+
+big_integer big_integer::operator-() const {
+  big_integer ans(*this);
+  ans.sgn_ = !sgn_ && !eq_zero();
+  return ans;
+}
+
+// ~x == -x - 1
+big_integer big_integer::operator~() const {
+  big_integer ans(*this);
+  if (sgn_) {
+    decrement(ans.data_);
+  } else {
+    increment(ans.data_);
+  }
+  ans.sgn_ = !sgn_;
+  return ans.delete_leading_zeroes();
+}
+
+big_integer& big_integer::operator++() {
+  return add_word(1, false);
+}
+
+big_integer big_integer::operator++(int) {
+  big_integer tmp(*this);
+  ++*this;
+  return tmp;
+}
+
+big_integer& big_integer::operator--() {
+  return add_word(1, true);
+}
+
+big_integer big_integer::operator--(int) {
+  big_integer tmp(*this);
+  --*this;
+  return tmp;
+}
+
+big_integer operator+(big_integer a, big_integer const& b) {
+  a += b;
+  return a;
+}
+
+big_integer operator+(big_integer const& a, big_integer&& b) {
+  b += a;
+  return std::move(b);
+}
+
+big_integer operator-(big_integer a, big_integer const& b) {
+  a -= b;
+  return a;
+}
+
+big_integer operator*(big_integer a, big_integer const& b) {
+  a *= b;
+  return a;
+}
+
+big_integer operator*(big_integer const& a, big_integer&& b) {
+  b *= a;
+  return std::move(b);
+}
+
+big_integer operator/(big_integer a, big_integer const& b) {
+  a /= b;
+  return a;
+}
+
+big_integer operator%(big_integer a, big_integer const& b) {
+  a %= b;
+  return a;
+}
+
+big_integer operator&(big_integer a, big_integer const& b) {
+  a &= b;
+  return a;
+}
+
+big_integer operator&(big_integer const& a, big_integer&& b) {
+  b &= a;
+  return std::move(b);
+}
+
+big_integer operator|(big_integer a, big_integer const& b) {
+  a |= b;
+  return a;
+}
+
+big_integer operator|(big_integer const& a, big_integer&& b) {
+  b |= a;
+  return std::move(b);
+}
+
+big_integer operator^(big_integer a, big_integer const& b) {
+  a ^= b;
+  return a;
+}
+
+big_integer operator^(big_integer const& a, big_integer&& b) {
+  b ^= a;
+  return std::move(b);
+}
+
+void divmod(big_integer const& a, big_integer const& b, big_integer& q, big_integer& r) {
+  if (b.eq_zero()) {
+    throw std::invalid_argument("Error while evaluating a / b: division by zero");
+  }
+  bool q_sgn = a.sgn_ != b.sgn_, r_sgn = a.sgn_;
+  if (&q == &a || &q == &b || &r == &a || &r == &b) {
+    digits qd, rd;
+    divide(a.data_, b.data_, qd, rd);
+    q.data_ = std::move(qd);
+    r.data_ = std::move(rd);
+  } else {
+    // writing straight into q and r reuses their buffers
+    divide(a.data_, b.data_, q.data_, r.data_);
+  }
+  q.sgn_ = q_sgn;
+  q.delete_leading_zeroes();
+  r.sgn_ = r_sgn;
+  r.delete_leading_zeroes();
+}
+
+std::pair<big_integer, big_integer> divmod(big_integer const& a, big_integer const& b) {
+  std::pair<big_integer, big_integer> result;
+  divmod(a, b, result.first, result.second);
+  return result;
+}
+
+big_integer square(big_integer const& a) {
+  big_integer r;
+  r.data_ = square(a.data_);
+  return r;
+}
+
+bool operator==(big_integer const& a, big_integer const& b) {
+  return a.sgn_ == b.sgn_ && a.data_ == b.data_;
+}
+
+bool operator!=(big_integer const& a, big_integer const& b) {
+  return !(a == b);
+}
+
+bool operator<(big_integer const& a, big_integer const& b) {
+  if (a.sgn_ != b.sgn_) {
+    return a.sgn_;
+  }
+  int cmp = compare_magnitude(a.data_, b.data_);
+  return a.sgn_ ? cmp > 0 : cmp < 0;
+}
+
+bool operator>(big_integer const& a, big_integer const& b) {
+  return b < a;
+}
+
+bool operator<=(big_integer const& a, big_integer const& b) {
+  return !(a > b);
+}
+
+bool operator>=(big_integer const& a, big_integer const& b) {
+  return !(a < b);
+}
+
+/// Native integer operands
+
+static constexpr size_t LIMBS_PER_UINT64 = (64 + LIMB_BITS - 1) / LIMB_BITS;
+
+// w as limbs in y, returns their number without leading zeroes
+size_t split_word(uint64_t w, limb* y) {
+  size_t n = 0;
+  for (; w != 0; w = uint64_t(double_limb(w) >> LIMB_BITS)) {
+    y[n++] = cast_to_limb(w);
+  }
+  return n;
+}
+
+// this += (w_sgn ? -w : w) in place
+big_integer& big_integer::add_word(uint64_t w, bool w_sgn) {
+  limb y[LIMBS_PER_UINT64];
+  size_t yn = split_word(w, y), an = size();
+  if (yn == 0) {
+    return *this;
+  }
+  if (an == 0 || sgn_ == w_sgn) {
+    sgn_ = w_sgn;
+    if (an < yn) {
+      data_.resize(yn);
+    }
+    if (add_n(data_.data(), data_.data(), size(), y, yn) != 0) {
+      data_.push_back(1);
+    }
+    return *this;
+  }
+  if (an > yn || compare_n(data_.data(), y, yn) >= 0) {
+    sub_n(data_.data(), data_.data(), an, y, yn);
+  } else {
+    // |this| < w, so the result fits in w's limbs and takes its sign
+    data_.resize(yn);
+    sub_n(data_.data(), y, yn, data_.data(), an);
+    sgn_ = w_sgn;
+  }
+  return delete_leading_zeroes();
+}
+
+big_integer& big_integer::mul_word(uint64_t w, bool w_sgn) {
+  limb y[LIMBS_PER_UINT64];
+  size_t yn = split_word(w, y), an = size();
+  if (yn == 0 || an == 0) {
+    data_.clear();
+    sgn_ = false;
+    return *this;
+  }
+  if (yn == 1) {
+    data_.resize(an + 1);
+    data_[an] = kernels().mul_limb(data_.data(), data_.data(), an, y[0]);
+  } else {
+    digits r(an + yn);
+    mul_basecase(r.data(), y, yn, data_.data(), an);
+    data_ = std::move(r);
+  }
+  sgn_ ^= w_sgn;
+  return delete_leading_zeroes();
+}
+
+// this / w rounded towards zero, or the remainder with the sign of this
+big_integer& big_integer::div_word(uint64_t w, bool w_sgn, bool remainder) {
+  limb y[LIMBS_PER_UINT64];
+  size_t yn = split_word(w, y);
+  if (yn == 0) {
+    throw std::invalid_argument("Error while evaluating a / b: division by zero");
+  }
+  if (yn == 1) {
+    limb r = divide_limb(data_, y[0]);
+    if (remainder) {
+      data_.assign(&r, &r + 1);
+    } else {
+      sgn_ ^= w_sgn;
+    }
+  } else {
+    digits q, r;
+    divide(data_, digits(y, y + yn), q, r);
+    if (remainder) {
+      data_ = std::move(r);
+    } else {
+      data_ = std::move(q);
+      sgn_ ^= w_sgn;
+    }
+  }
+  return delete_leading_zeroes();
+}
+
+// sign of this - (w_sgn ? -w : w)
+int big_integer::compare_word(uint64_t w, bool w_sgn) const {
+  limb y[LIMBS_PER_UINT64];
+  size_t yn = split_word(w, y), an = size();
+  w_sgn = w_sgn && yn != 0;
+  if (sgn_ != w_sgn) {
+    return sgn_ ? -1 : 1;
+  }
+  int cmp = an != yn ? (an < yn ? -1 : 1) : compare_n(data_.data(), y, yn);
+  return sgn_ ? -cmp : cmp;
+}
+
+/// Linear combinations
+
+// The sum is accumulated block by block: within a block every operand is added or subtracted by the carry
+// chain kernels, each operand keeping its own carry into the next block. That is a single pass over memory
+// that still runs at the speed of the kernels
+static constexpr size_t SUM_BLOCK = 256;
+
+big_integer& big_integer::assign_terms(term const* terms, size_t n) {
+  struct operand {
+    big_integer const* value; // null for a product
+    limb const* data;
+    size_t size;
+    bool negative;
+    limb carry;
+  };
+  // per-thread buffers keep their capacity from one evaluation to the next
+  thread_local std::vector<digits> products;
+  thread_local std::vector<operand> operands;
+  thread_local digits copy;
+  if (products.size() < n) {
+    products.resize(n);
+  }
+  operands.clear();
+  size_t width = 0, aliased = 0;
+  for (size_t j = 0; j < n; j++) {
+    big_integer const& a = *terms[j].a;
+    if (a.eq_zero()) {
+      continue;
+    }
+    if (terms[j].b == nullptr) {
+      operands.push_back({&a, nullptr, a.size(), terms[j].negative != a.sgn_, 0});
+      width = std::max(width, a.size());
+      if (&a == this) {
+        // this is read in place as the first operand, copied first in r
+        std::swap(operands[aliased++], operands.back());
+      }
+    } else if (!terms[j].b->eq_zero()) {
+      // products are taken before this is written, so their factors may be this
+      big_integer const& b = *terms[j].b;
+      digits& p = products[j];
+      p.resize(a.size() + b.size());
+      mul_rec(p.data(), a.data_.data(), a.size(), b.data_.data(), b.size());
+      operands.push_back({nullptr, p.data(), p.size(), terms[j].negative != (a.sgn_ != b.sgn_), 0});
+      width = std::max(width, p.size());
+    }
+  }
+  if (operands.empty()) {
+    data_.clear();
+    sgn_ = false;
+    return *this;
+  }
+
+  if (aliased == 0) {
+    data_.clear();
+  }
+  // grown before any operand pointer is taken, the old value of this stays where it is read from
+  data_.reserve(width + 1);
+  for (operand& o : operands) {
+    if (o.value != nullptr) {
+      o.data = o.value->data_.data();
+    }
+  }
+  if (aliased > 1) {
+    // further occurrences of this would be read after r has been written
+    copy.assign(data_.begin(), data_.end());
+    for (size_t j = 1; j < aliased; j++) {
+      operands[j].data = copy.data();
+    }
+  }
+  // r = |x_0| +- |x_1| +- ..., the signs relative to x_0's
+  operand const& base = operands[0];
+  if (aliased == 0) {
+    data_.assign(base.data, base.data + base.size);
+  }
+  data_.resize(width + 1);
+  limb_kernels const& k = kernels();
+  limb* r = data_.data();
+  for (size_t from = 0; from < width; from += SUM_BLOCK) {
+    size_t to = std::min(from + SUM_BLOCK, width);
+    for (size_t j = 1; j < operands.size(); j++) {
+      operand& o = operands[j];
+      bool sub = o.negative != base.negative;
+      size_t end = std::min(to, std::max(from, o.size));
+      limb c = o.carry;
+      if (from < end) {
+        c = sub ? k.sub_nn(r + from, r + from, o.data + from, end - from, c)
+                : k.add_nn(r + from, r + from, o.data + from, end - from, c);
+      }
+      for (size_t i = end; c != 0 && i < to; i++) {
+        c = sub ? r[i]-- == 0 : ++r[i] == 0;
+      }
+      o.carry = c;
+    }
+  }
+  signed_double_limb top = 0;
+  for (size_t j = 1; j < operands.size(); j++) {
+    top += operands[j].negative != base.negative ? -signed_double_limb(operands[j].carry) : operands[j].carry;
+  }
+  // a negative sum is turned from two's complement back into a magnitude
+  r[width] = cast_to_limb(top);
+  sgn_ = base.negative != (top < 0);
+  if (top < 0) {
+    negate_n(r, width + 1);
+  }
+  return delete_leading_zeroes();
+}
+
+/// Multiply-accumulate
+
+// r[0, rn) +-= a[0, an) * b[0, bn) for rn > an + bn; returns the borrow out of r[rn) when subtracting.
+// Below the Karatsuba threshold every row goes straight into r, larger products pass through a per-thread buffer
+limb addmul_n(limb* r, size_t rn, limb const* a, size_t an, limb const* b, size_t bn, bool subtract) {
+  if (std::min(an, bn) >= KARATSUBA_THRESHOLD) {
+    thread_local digits product;
+    product.resize(an + bn);
+    mul_rec(product.data(), a, an, b, bn);
+    if (subtract) {
+      return sub_from(r, rn, product.data(), an + bn);
+    }
+    add_into(r, rn, product.data(), an + bn);
+    return 0;
+  }
+  if (an < bn) {
+    std::swap(a, b);
+    std::swap(an, bn);
+  }
+  limb_kernels const& k = kernels();
+  limb out = 0;
+  for (size_t i = 0; i < bn; i++) {
+    limb c = subtract ? k.submul_limb(r + i, a, an, b[i]) : k.addmul_limb(r + i, a, an, b[i]);
+    size_t j = i + an;
+    for (; c != 0 && j < rn; j++) {
+      limb x = r[j];
+      r[j] = subtract ? x - c : x + c;
+      c = subtract ? x < c : r[j] < c;
+    }
+    out += c;
+  }
+  return out;
+}
+
+void big_integer::addmul_limbs(big_integer const& a, limb const* b, size_t bn, bool b_sgn, bool subtract) {
+  if (a.eq_zero() || bn == 0) {
+    return;
+  }
+  if (&a == this || b == data_.data()) {
+    // an operand would change while it is read
+    big_integer p;
+    p.addmul_limbs(a, b, bn, b_sgn, false);
+    add_signed(p, p.sgn_ != subtract);
+    return;
+  }
+  bool p_sgn = (a.sgn_ != b_sgn) != subtract;
+  if (eq_zero()) {
+    sgn_ = p_sgn;
+  }
+  size_t an = a.size(), rn = std::max(size(), an + bn) + 1;
+  data_.resize(rn);
+  limb* r = data_.data();
+  // the magnitudes are added when the signs agree; otherwise a borrow out means the product was the larger
+  if (addmul_n(r, rn, a.data_.data(), an, b, bn, sgn_ != p_sgn) != 0) {
+    negate_n(r, rn);
+    sgn_ = !sgn_;
+  }
+  delete_leading_zeroes();
+}
+
+void big_integer::addmul_word(big_integer const& a, uint64_t w, bool w_sgn, bool subtract) {
+  limb y[LIMBS_PER_UINT64];
+  addmul_limbs(a, y, split_word(w, y), w_sgn, subtract);
+}
+
+void addmul(big_integer& acc, big_integer const& a, big_integer const& b) {
+  acc.addmul_limbs(a, b.data_.data(), b.size(), b.sgn_, false);
+}
+
+void submul(big_integer& acc, big_integer const& a, big_integer const& b) {
+  acc.addmul_limbs(a, b.data_.data(), b.size(), b.sgn_, true);
+}
+
+/// Modular arithmetic
+
+// -m^-1 mod B for odd m; m * m = 1 mod 8, and every Newton step doubles the number of correct low bits
+limb montgomery_inverse(limb m) {
+  limb inv = m;
+  for (unsigned bits = 3; bits < LIMB_BITS; bits *= 2) {
+    inv *= 2 - m * inv;
+  }
+  return limb(0) - inv;
+}
+
+// r[0, n) = t * B^-n mod m for t[0, 2n) < m * B^n; t is clobbered
+void redc(limb* r, limb* t, limb const* m, size_t n, limb m_inv) {
+  limb_kernels const& k = kernels();
+  for (size_t i = 0; i < n; i++) {
+    // row i clears t[i], which then holds the row's carry out until all of them are added at t[n]
+    t[i] = k.addmul_limb(t + i, m, n, t[i] * m_inv);
+  }
+  limb carry = k.add_nn(r, t + n, t, n, 0);
+  if (carry != 0 || compare_n(r, m, n) >= 0) {
+    k.sub_nn(r, r, m, n, 0);
+  }
+}
+
+// R^2 mod m for R = B^n, n limbs in m, padded to n limbs
+digits montgomery_r2(digits const& m) {
+  size_t n = m.size();
+  digits power(2 * n + 1), q, r2;
+  power[2 * n] = 1;
+  divide(power, m, q, r2);
+  r2.resize(n);
+  return r2;
+}
+
+// Products of n-limb residues in Montgomery form; r may be a or b
+struct montgomery_arith {
+  limb const* m;
+  size_t n;
+  limb m_inv;
+  digits t;
+
+  montgomery_arith(limb const* m, size_t n, limb m_inv) : m(m), n(n), m_inv(m_inv), t(2 * n) {}
+
+  void mul(limb* r, limb const* a, limb const* b) {
+    mul_rec(t.data(), a, n, b, n);
+    redc(r, t.data(), m, n, m_inv);
+  }
+
+  void sqr(limb* r, limb const* a) {
+    sqr_rec(t.data(), a, n);
+    redc(r, t.data(), m, n, m_inv);
+  }
+};
+
+// Products of n-limb residues reduced by division, for even moduli
+struct division_arith {
+  digits m;
+  size_t n;
+  digits t, q, rem;
+
+  explicit division_arith(digits const& m) : m(m), n(m.size()), t(2 * m.size()) {}
+
+  void mul(limb* r, limb const* a, limb const* b) {
+    mul_rec(t.data(), a, n, b, n);
+    reduce(r);
+  }
+
+  void sqr(limb* r, limb const* a) {
+    sqr_rec(t.data(), a, n);
+    reduce(r);
+  }
+
+  void reduce(limb* r) {
+    digits p(t.data(), t.data() + 2 * n);
+    trim(p);
+    divide(p, m, q, rem);
+    std::fill(std::copy(rem.begin(), rem.end(), r), r + n, 0);
+  }
+};
+
+// Window width for an exponent of the given length, balancing the 2^(w - 1) precomputed odd powers
+// against the multiplications they save
+unsigned window_bits(size_t bits) {
+  static constexpr size_t limits[] = {24, 80, 240, 672, 1792};
+  unsigned w = 1;
+  while (w <= 5 && bits > limits[w - 1]) {
+    w++;
+  }
+  return w;
+}
+
+// x[0, n) = a^e for an n-limb residue a and e > 0, scanning e from the top with a sliding window
+template <typename Arith>
+void pow_window(Arith& ar, limb* x, limb const* a, digits const& e) {
+  size_t n = ar.n;
+  size_t bits = e.size() * LIMB_BITS - leading_zeroes(e.back());
+  unsigned w = window_bits(bits);
+  // table[i] = a^(2i + 1)
+  digits table(n << (w - 1)), a2(n);
+  std::copy(a, a + n, table.data());
+  if (w > 1) {
+    ar.sqr(a2.data(), a);
+    for (size_t i = 1; i < (size_t(1) << (w - 1)); i++) {
+      ar.mul(table.data() + i * n, table.data() + (i - 1) * n, a2.data());
+    }
+  }
+
+  auto bit = [&e](size_t i) { return (e[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1; };
+  bool started = false;
+  for (size_t i = bits; i-- > 0; ) {
+    if (!bit(i)) {
+      ar.sqr(x, x);
+      continue;
+    }
+    // the longest window of at most w bits starting at bit i and ending in a one
+    size_t low = i + 1 > w ? i + 1 - w : 0;
+    while (!bit(low)) {
+      low++;
+    }
+    size_t value = 0;
+    for (size_t j = i + 1; j-- > low; ) {
+      value = value << 1 | bit(j);
+    }
+    limb const* power = table.data() + (value >> 1) * n;
+    if (started) {
+      for (size_t j = low; j <= i; j++) {
+        ar.sqr(x, x);
+      }
+      ar.mul(x, x, power);
+    } else {
+      std::copy(power, power + n, x);
+      started = true;
+    }
+    i = low;
+  }
+}
+
+// a mod m in [0, m) for the magnitude a with sign a_sgn, padded to m.size() limbs
+digits residue(digits const& a, bool a_sgn, digits const& m) {
+  digits q, r;
+  divide(a, m, q, r);
+  if (a_sgn && !r.empty()) {
+    digits t(m.size());
+    sub_n(t.data(), m.data(), m.size(), r.data(), r.size());
+    r = std::move(t);
+  }
+  r.resize(m.size());
+  return r;
+}
+
+montgomery_context::montgomery_context(big_integer const& m) : m_(m) {
+  if (m.eq_zero() || !(m.data_[0] & 1)) {
+    throw std::invalid_argument("Error while creating montgomery_context: modulus is not odd");
+  }
+  m_.sgn_ = false;
+  m_inv_ = montgomery_inverse(m.data_[0]);
+  r2_ = montgomery_r2(m_.data_);
+}
+
+big_integer const& montgomery_context::modulus() const {
+  return m_;
+}
+
+big_integer montgomery_context::mul_mod(big_integer const& a, big_integer const& b) const {
+  digits const& m = m_.data_;
+  montgomery_arith ar(m.data(), m.size(), m_inv_);
+  digits x = residue(a.data_, a.sgn_, m);
+  digits y = residue(b.data_, b.sgn_, m);
+  // x * y / R, then multiplying by R^2 / R restores x * y
+  ar.mul(x.data(), x.data(), y.data());
+  ar.mul(x.data(), x.data(), r2_.data());
+  big_integer r;
+  r.data_ = std::move(x);
+  return r.delete_leading_zeroes();
+}
+
+big_integer montgomery_context::pow_mod(big_integer const& a, big_integer const& e) const {
+  if (e.sgn_) {
+    throw std::invalid_argument("Error while evaluating pow_mod: negative exponent");
+  }
+  digits const& m = m_.data_;
+  size_t n = m.size();
+  big_integer r;
+  if (n == 1 && m[0] == 1) {
+    return r;
+  }
+  if (e.eq_zero()) {
+    return 1;
+  }
+  montgomery_arith ar(m.data(), n, m_inv_);
+  digits base = residue(a.data_, a.sgn_, m), x(n);
+  ar.mul(base.data(), base.data(), r2_.data());
+  pow_window(ar, x.data(), base.data(), e.data_);
+  // leaving Montgomery form is a reduction of x itself
+  std::fill(std::copy(x.begin(), x.end(), ar.t.begin()), ar.t.end(), 0);
+  redc(x.data(), ar.t.data(), m.data(), n, m_inv_);
+  r.data_ = std::move(x);
+  return r.delete_leading_zeroes();
+}
+
+big_integer pow_mod(big_integer const& a, big_integer const& e, big_integer const& m) {
+  if (m.eq_zero()) {
+    throw std::invalid_argument("Error while evaluating pow_mod: division by zero");
+  }
+  if (m.data_[0] & 1) {
+    return montgomery_context(m).pow_mod(a, e);
+  }
+  if (e.sgn_) {
+    throw std::invalid_argument("Error while evaluating pow_mod: negative exponent");
+  }
+  if (e.eq_zero()) {
+    return 1;
+  }
+  division_arith ar(m.data_);
+  digits base = residue(a.data_, a.sgn_, m.data_), x(ar.n);
+  pow_window(ar, x.data(), base.data(), e.data_);
+  big_integer r;
+  r.data_ = std::move(x);
+  return r.delete_leading_zeroes();
+}
+
+// Barrett steps take two full products, which only undercut the quadratic Knuth loop for large moduli
+#ifndef BIG_INTEGER_BARRETT_THRESHOLD
+#ifdef BIG_INTEGER_64BIT_LIMBS
+#define BIG_INTEGER_BARRETT_THRESHOLD 640
+#else
+#define BIG_INTEGER_BARRETT_THRESHOLD 1024
+#endif
+#endif
+
+static constexpr size_t BARRETT_THRESHOLD = BIG_INTEGER_BARRETT_THRESHOLD;
+
+// r[0, n) = t mod v for t[0, 2n) with its top half below v, where v has its top bit set and mu = B^2n / v
+// has n + 1 limbs. The quotient estimate from the top n + 1 limbs of t is short by at most 2
+void barrett_step(limb* r, limb const* t, limb const* v, limb const* mu, size_t n, limb* scratch) {
+  limb* p = scratch;
+  limb* qv = p + 2 * n + 2;
+  limb* rr = qv + 2 * n + 1;
+  mul_rec(p, t + n - 1, n + 1, mu, n + 1);
+  mul_rec(qv, p + n + 1, n + 1, v, n);
+  // the remainder is below 3v < B^(n + 1), so the low n + 1 limbs of the difference are exact
+  kernels().sub_nn(rr, t, qv, n + 1, 0);
+  while (rr[n] != 0 || compare_n(rr, v, n) >= 0) {
+    rr[n] -= sub_n(rr, rr, n, v, n);
+  }
+  std::copy(rr, rr + n, r);
+}
+
+// |a| mod m, given v = m << shift with the top bit set and mu = B^2n / v
+digits reduce_magnitude(digits const& a, digits const& v, digits const& mu, unsigned shift) {
+  size_t n = v.size();
+  if (a.size() < n) {
+    return a;
+  }
+  digits r(n);
+  if (n == 1) {
+    // the single-limb divisor needs no normalization
+    r[0] = mod_limb(a, v[0] >> shift);
+    trim(r);
+    return r;
+  }
+
+  thread_local digits workspace;
+  size_t blocks = a.size() / n + 1;
+  // the dividend, then room for either the Knuth quotient or the Barrett products
+  workspace.resize(blocks * n + std::max(a.size() - n + 1, 5 * n + 4));
+  limb* u = workspace.data();
+  std::fill(u + a.size() + 1, u + blocks * n, 0);
+  u[a.size()] = kernels().shl_n(u, a.data(), a.size(), shift);
+  limb* scratch = u + blocks * n;
+  if (n < BARRETT_THRESHOLD) {
+    divide_knuth_n(scratch, u, a.size() - n, v.data(), n);
+  } else {
+    // long division by n-limb blocks, each step a Barrett reduction of 2n limbs; the top block is at most
+    // n - 1 limbs of a plus the shifted-out limb, so it is already below v
+    for (size_t j = blocks - 1; j-- > 0; ) {
+      barrett_step(u + j * n, u + j * n, v.data(), mu.data(), n, scratch);
+    }
+  }
+  kernels().shr_n(r.data(), u, n, shift);
+  trim(r);
+  return r;
+}
+
+modulus::modulus(big_integer const& m) : m_(m) {
+  if (m.eq_zero()) {
+    throw std::invalid_argument("Error while creating modulus: division by zero");
+  }
+  m_.sgn_ = false;
+  size_t n = m.size();
+  shift_ = leading_zeroes(m.data_.back());
+  v_.resize(n);
+  kernels().shl_n(v_.data(), m.data_.data(), n, shift_);
+  digits power(2 * n + 1), rem;
+  power[2 * n] = 1;
+  divide(power, v_, mu_, rem);
+  mu_.resize(n + 1);
+}
+
+big_integer const& modulus::value() const {
+  return m_;
+}
+
+big_integer modulus::reduce(big_integer const& a) const {
+  big_integer r;
+  r.data_ = reduce_magnitude(a.data_, v_, mu_, shift_);
+  if (a.sgn_ && !r.eq_zero()) {
+    r.data_ = sub_magnitude(m_.data_, r.data_);
+  }
+  return r;
+}
+
+big_integer modulus::mul_mod(big_integer const& a, big_integer const& b) const {
+  digits x = reduce_magnitude(a.data_, v_, mu_, shift_);
+  digits y = &a == &b ? x : reduce_magnitude(b.data_, v_, mu_, shift_);
+  big_integer r;
+  r.data_ = reduce_magnitude(multiply(x, y), v_, mu_, shift_);
+  if (a.sgn_ != b.sgn_ && !r.eq_zero()) {
+    r.data_ = sub_magnitude(m_.data_, r.data_);
+  }
+  return r;
+}
+
+big_integer modulus::add_mod(big_integer const& a, big_integer const& b) const {
+  if (a.sgn_ || b.sgn_ || compare_magnitude(a.data_, m_.data_) >= 0 || compare_magnitude(b.data_, m_.data_) >= 0) {
+    return reduce(a + b);
+  }
+  // both operands are residues already, one subtraction at most
+  big_integer r;
+  r.data_ = add_magnitude(a.data_, b.data_);
+  if (compare_magnitude(r.data_, m_.data_) >= 0) {
+    r.data_ = sub_magnitude(r.data_, m_.data_);
+  }
+  return r;
+}
+
+/// Powers and roots
+
+big_integer pow(big_integer const& a, unsigned e) {
+  big_integer r = 1;
+  if (e == 0) {
+    return r;
+  }
+  // left to right, so the multiplications are by a itself rather than by growing powers
+  unsigned bit = 1u << (31 - __builtin_clz(e));
+  r.data_ = a.data_;
+  for (bit >>= 1; bit != 0; bit >>= 1) {
+    r.data_ = square(r.data_);
+    if (e & bit) {
+      r.data_ = multiply(r.data_, a.data_);
+    }
+  }
+  r.sgn_ = a.sgn_ && (e & 1);
+  return r.delete_leading_zeroes();
+}
+
+size_t bit_length(digits const& a) {
+  return a.empty() ? 0 : a.size() * LIMB_BITS - leading_zeroes(a.back());
+}
+
+// log2(a) for a != 0 from its top 64 or more bits
+double top_log2(digits const& a) {
+  size_t take = std::min(a.size(), size_t(64 / LIMB_BITS + 1));
+  double top = 0;
+  for (size_t i = a.size(); i-- > a.size() - take; ) {
+    top = top * double(BASE) + double(a[i]);
+  }
+  return std::log2(top) + double((a.size() - take) * LIMB_BITS);
+}
+
+// floor(a^(1/k)) for a > 0 with the given bit length and log2, by Newton's iteration
+// x = ((k - 1)x + a / x^(k - 1)) / k, which never drops below the floor of the root from a start above it
+big_integer root_magnitude(big_integer const& a, unsigned k, size_t bits, double lg) {
+  if (bits / k < 48) {
+    // the root fits a double; the estimate carries the rounding of lg, so make sure it starts above the root
+    big_integer x = static_cast<unsigned long long>(std::exp2(lg / k) * (1 + 1e-9)) + 1;
+    while (pow(x, k) <= a) {
+      x <<= 1;
+    }
+    for (;;) {
+      big_integer y = ((k - 1) * x + a / pow(x, k - 1)) / k;
+      if (y >= x) {
+        return x;
+      }
+      x = std::move(y);
+    }
+  }
+  // The root of the top part of a, kept g bits more precise than half of the result, is off by at most 2^s.
+  // One step squares that error down to (k - 1) 2^(1 - 2g) < 1, leaving at most one correction
+  size_t g = 2;
+  while ((size_t(1) << g) < k) {
+    g++;
+  }
+  size_t s = bits / (2 * k) - std::min(g, bits / (4 * k));
+  big_integer x = (root_magnitude(a >> k * s, k, bits - k * s, lg - double(k * s)) + 1) << s;
+  x = ((k - 1) * x + a / pow(x, k - 1)) / k;
+  while (pow(x, k) > a) {
+    --x;
+  }
+  return x;
+}
+
+big_integer iroot(big_integer const& a, unsigned k) {
+  if (k == 0) {
+    throw std::invalid_argument("Error while evaluating iroot: zeroth root");
+  }
+  if (a.sgn_ && k % 2 == 0) {
+    throw std::invalid_argument("Error while evaluating iroot: even root of a negative number");
+  }
+  if (k == 1 || a.eq_zero()) {
+    return a;
+  }
+  big_integer r = root_magnitude(a.sgn_ ? -a : a, k, bit_length(a.data_), top_log2(a.data_));
+  r.sgn_ = a.sgn_;
+  return r;
+}
+
+big_integer isqrt(big_integer const& a) {
+  return iroot(a, 2);
+}
+
+/// Greatest common divisor
+
+// floor(a / 2^shift) mod 2^64
+uint64_t bits_at(digits const& a, size_t shift) {
+  size_t i = shift / LIMB_BITS;
+  unsigned o = shift % LIMB_BITS;
+  uint64_t r = 0;
+  for (size_t j = i, at = 0; j < a.size() && at < 64 + o; j++, at += LIMB_BITS) {
+    r |= at < o ? uint64_t(a[j] >> o) : uint64_t(a[j]) << (at - o);
+  }
+  return r;
+}
+
+digits from_word(uint64_t x) {
+  digits r;
+  for (; x != 0; x = uint64_t(double_limb(x) >> LIMB_BITS)) {
+    r.push_back(cast_to_limb(x));
+  }
+  return r;
+}
+
+// (u, v) -> (a u + b v, c u + d v), one row of Euclid's remainder sequence mapped to a later one.
+// The entries alternate in sign, b > 0 exactly when the number of steps taken is odd
+struct lehmer_matrix {
+  int64_t a, b, c, d;
+};
+
+// Knuth's algorithm L on the leading bits uh >= vh of u >= v, both below 2^62: the run of Euclid steps whose
+// quotients those bits determine. All intermediate values stay within 62 bits; the cofactors are also kept
+// within a limb, so applying the matrix is a pair of single-limb multiplications per row
+lehmer_matrix lehmer_run(int64_t uh, int64_t vh) {
+  static constexpr int64_t limit = LIMB_BITS < 64 ? int64_t(LIMB_MAX) : INT64_MAX;
+  lehmer_matrix m = {1, 0, 0, 1};
+  while (vh + m.c != 0 && vh + m.d != 0) {
+    int64_t q = (uh + m.a) / (vh + m.c);
+    if (q != (uh + m.b) / (vh + m.d)) {
+      break;
+    }
+    int64_t c = m.a - q * m.c, d = m.b - q * m.d;
+    if (std::max(std::abs(c), std::abs(d)) > limit) {
+      break;
+    }
+    m = {m.c, m.d, c, d};
+    int64_t t = uh - q * vh;
+    uh = vh;
+    vh = t;
+  }
+  return m;
+}
+
+limb abs_limb(int64_t x) {
+  return limb(x < 0 ? 0 - uint64_t(x) : uint64_t(x));
+}
+
+// r[0, n] = x u + y v for cofactors of opposite signs (or a zero one) whose combination is known to be
+// non-negative
+void combine(limb* r, limb const* u, int64_t x, limb const* v, int64_t y, size_t n) {
+  limb_kernels const& k = kernels();
+  if (y > 0) {
+    std::swap(u, v);
+    std::swap(x, y);
+  }
+  r[n] = k.mul_limb(r, u, n, limb(x));
+  r[n] -= k.submul_limb(r, v, n, abs_limb(y));
+}
+
+// r = x u + y v for magnitudes u, v and limbs x, y
+void combine_magnitudes(digits& r, digits& u, limb x, digits& v, limb y) {
+  size_t n = std::max(u.size(), v.size());
+  u.resize(n);
+  v.resize(n);
+  r.resize(n + 2);
+  limb_kernels const& k = kernels();
+  r[n] = k.mul_limb(r.data(), u.data(), n, x);
+  limb carry = k.addmul_limb(r.data(), v.data(), n, y);
+  r[n] += carry;
+  r[n + 1] = r[n] < carry;
+  trim(u);
+  trim(v);
+  trim(r);
+}
+
+// gcd(u, v) for magnitudes u >= v by Lehmer's algorithm. With s given, also finds s * u = gcd (mod v).
+// The cofactors s_i of the remainders have sign (-1)^i, so only their magnitudes s0, s1 and the parity of
+// the index are tracked, and every update is a sum: |s_i+1| = |s_i-1| + q |s_i|
+digits gcd_magnitude(digits u, digits v, signed_digits* s) {
+  digits s0 = from_word(1), s1, q, t, w;
+  bool odd = false;
+  while (!v.empty() && bit_length(u) > 62) {
+    size_t shift = bit_length(u) - 62;
+    lehmer_matrix m = lehmer_run(int64_t(bits_at(u, shift)), int64_t(bits_at(v, shift)));
+    if (m.b == 0) {
+      // the leading bits did not determine even one quotient, take a full division step
+      divide(u, v, q, t);
+      std::swap(u, v);
+      std::swap(v, t);
+      if (s) {
+        t = add_magnitude(s0, multiply(q, s1));
+        std::swap(s0, s1);
+        std::swap(s1, t);
+        odd = !odd;
+      }
+      continue;
+    }
+    size_t n = u.size();
+    v.resize(n);
+    t.resize(n + 1);
+    w.resize(n + 1);
+    combine(t.data(), u.data(), m.a, v.data(), m.b, n);
+    combine(w.data(), u.data(), m.c, v.data(), m.d, n);
+    trim(t);
+    trim(w);
+    std::swap(u, t);
+    std::swap(v, w);
+    if (s) {
+      combine_magnitudes(t, s0, abs_limb(m.a), s1, abs_limb(m.b));
+      combine_magnitudes(w, s0, abs_limb(m.c), s1, abs_limb(m.d));
+      std::swap(s0, t);
+      std::swap(s1, w);
+      odd ^= m.b > 0;
+    }
+  }
+  if (!v.empty()) {
+    // both fit a word now
+    uint64_t x = bits_at(u, 0), y = bits_at(v, 0);
+    while (y != 0) {
+      uint64_t qw = x / y, r = x - qw * y;
+      x = y;
+      y = r;
+      if (s) {
+        t = add_magnitude(s0, multiply(from_word(qw), s1));
+        std::swap(s0, s1);
+        std::swap(s1, t);
+        odd = !odd;
+      }
+    }
+    u = from_word(x);
+  }
+  if (s) {
+    *s = {s0, odd && !s0.empty()};
+  }
+  return u;
+}
+
+big_integer gcd(big_integer const& a, big_integer const& b) {
+  bool swap = compare_magnitude(a.data_, b.data_) < 0;
+  big_integer r;
+  r.data_ = gcd_magnitude(swap ? b.data_ : a.data_, swap ? a.data_ : b.data_, nullptr);
+  return r;
+}
+
+void extended_gcd(big_integer const& a, big_integer const& b, big_integer& g, big_integer& x, big_integer& y) {
+  big_integer rg, rx, ry;
+  if (b.eq_zero()) {
+    rg = a.sgn_ ? -a : a;
+    rx = a.eq_zero() ? 0 : a.sgn_ ? -1 : 1;
+  } else if (a.eq_zero()) {
+    rg = b.sgn_ ? -b : b;
+    ry = b.sgn_ ? -1 : 1;
+  } else {
+    // s for the larger magnitude u, then the other cofactor from s u + t v = g
+    bool swap = compare_magnitude(a.data_, b.data_) < 0;
+    digits const& u = swap ? b.data_ : a.data_;
+    digits const& v = swap ? a.data_ : b.data_;
+    signed_digits s;
+    rg.data_ = gcd_magnitude(u, v, &s);
+    big_integer bu, bv;
+    bu.data_ = u;
+    bv.data_ = v;
+    rx.data_ = std::move(s.mag);
+    rx.sgn_ = s.neg;
+    ry = (rg - rx * bu) / bv;
+    if (swap) {
+      std::swap(rx, ry);
+    }
+    if (a.sgn_) rx = -rx;
+    if (b.sgn_) ry = -ry;
+  }
+  g = std::move(rg);
+  x = std::move(rx);
+  y = std::move(ry);
+}
+
+big_integer mod_inverse(big_integer const& a, big_integer const& m) {
+  if (m == 0) {
+    throw std::invalid_argument("Error while evaluating mod_inverse: division by zero");
+  }
+  big_integer am = m < 0 ? -m : m;
+  big_integer g, x, y;
+  extended_gcd(a % am, am, g, x, y);
+  if (g != 1) {
+    throw std::invalid_argument("Error while evaluating mod_inverse: a is not invertible modulo m");
+  }
+  x %= am;
+  if (x < 0) {
+    x += am;
+  }
+  return x;
+}
+
+/// Primality
+
+static constexpr uint32_t TRIAL_DIVISION_LIMIT = 1024;
+static constexpr uint32_t SIEVE_LIMIT = 1 << 16;
+static constexpr size_t SIEVE_WINDOW = 4096;
+
+// primes below SIEVE_LIMIT
+std::vector<uint32_t> const& small_primes() {
+  static std::vector<uint32_t> const primes = [] {
+    std::vector<bool> composite(SIEVE_LIMIT);
+    std::vector<uint32_t> r;
+    for (uint32_t i = 2; i < SIEVE_LIMIT; i++) {
+      if (!composite[i]) {
+        r.push_back(i);
+        for (uint32_t j = i * i; j < SIEVE_LIMIT; j += i) {
+          composite[j] = true;
+        }
+      }
+    }
+    return r;
+  }();
+  return primes;
+}
+
+// r[i - from] = a mod primes[i] for i in [from, to), reading a once per group of primes whose product fits a limb
+void small_residues(digits const& a, size_t from, size_t to, std::vector<uint32_t>& r) {
+  std::vector<uint32_t> const& primes = small_primes();
+  r.resize(to - from);
+  for (size_t i = from; i < to; ) {
+    limb product = primes[i];
+    size_t j = i + 1;
+    while (j < to && product <= LIMB_MAX / primes[j]) {
+      product *= primes[j++];
+    }
+    limb rem = mod_limb(a, product);
+    for (; i < j; i++) {
+      r[i - from] = uint32_t(rem % primes[i]);
+    }
+  }
+}
+
+// Divides a by the largest power of two dividing it, a != 0; returns the exponent
+size_t strip_twos(digits& a) {
+  size_t limbs = 0;
+  while (a[limbs] == 0) {
+    limbs++;
+  }
+  unsigned bits = __builtin_ctzll(a[limbs]);
+  kernels().shr_n(a.data(), a.data() + limbs, a.size() - limbs, bits);
+  a.resize(a.size() - limbs);
+  trim(a);
+  return limbs * LIMB_BITS + bits;
+}
+
+// Montgomery arithmetic on n-limb residues modulo an odd m, with the additions and halving that Lucas sequences need
+struct montgomery_field : montgomery_arith {
+  digits r2, one, minus_one;
+
+  explicit montgomery_field(digits const& m)
+      : montgomery_arith(m.data(), m.size(), montgomery_inverse(m[0])), r2(montgomery_r2(m)), one(m.size()),
+        minus_one(m.size()) {
+    one[0] = 1;
+    to_montgomery(one.data(), one.data());
+    kernels().sub_nn(minus_one.data(), m.data(), one.data(), n, 0);
+  }
+
+  void to_montgomery(limb* r, limb const* a) {
+    mul(r, a, r2.data());
+  }
+
+  void add(limb* r, limb const* a, limb const* b) {
+    limb carry = kernels().add_nn(r, a, b, n, 0);
+    if (carry != 0 || compare_n(r, m, n) >= 0) {
+      kernels().sub_nn(r, r, m, n, 0);
+    }
+  }
+
+  void sub(limb* r, limb const* a, limb const* b) {
+    if (kernels().sub_nn(r, a, b, n, 0) != 0) {
+      kernels().add_nn(r, r, m, n, 0);
+    }
+  }
+
+  // r = a / 2, adding m first when a is odd
+  void half(limb* r, limb const* a) {
+    limb carry = 0;
+    if (a[0] & 1) {
+      carry = kernels().add_nn(r, a, m, n, 0);
+    } else if (r != a) {
+      std::copy(a, a + n, r);
+    }
+    kernels().shr_n(r, r, n, 1);
+    r[n - 1] |= carry << (LIMB_BITS - 1);
+  }
+};
+
+bool is_zero(digits const& a) {
+  return std::all_of(a.begin(), a.end(), [](limb x) { return x == 0; });
+}
+
+// Strong probable-prime test of m to an n-limb base 1 < a < m - 1, where m - 1 = d 2^s
+bool miller_rabin(montgomery_field& f, digits const& a, digits const& d, size_t s) {
+  digits b(f.n), x(f.n);
+  f.to_montgomery(b.data(), a.data());
+  pow_window(f, x.data(), b.data(), d);
+  if (x == f.one || x == f.minus_one) {
+    return true;
+  }
+  for (size_t i = 1; i < s; i++) {
+    f.sqr(x.data(), x.data());
+    if (x == f.minus_one) {
+      return true;
+    }
+    if (x == f.one) {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Jacobi symbol (a / b) for odd b
+int jacobi(uint64_t a, uint64_t b) {
+  int r = 1;
+  a %= b;
+  while (a != 0) {
+    while (a % 2 == 0) {
+      a /= 2;
+      if (b % 8 == 3 || b % 8 == 5) {
+        r = -r;
+      }
+    }
+    std::swap(a, b);
+    if (a % 4 == 3 && b % 4 == 3) {
+      r = -r;
+    }
+    a %= b;
+  }
+  return b == 1 ? r : 0;
+}
+
+// Strong Lucas probable-prime test of an odd m > 2^16 that is not a square, with Selfridge's parameters: the first
+// D in 5, -7, 9, -11, ... with (D / m) = -1, P = 1 and Q = (1 - D) / 4
+bool strong_lucas(montgomery_field& f, digits const& m) {
+  int64_t d = 5;
+  for (;;) {
+    uint64_t k = d < 0 ? -d : d;
+    // quadratic reciprocity for odd k and m, times (-1 / m) for negative D
+    int j = jacobi(mod_limb(m, limb(k)), k);
+    if ((k % 4 == 3 && m[0] % 4 == 3) != (d < 0 && m[0] % 4 == 3)) {
+      j = -j;
+    }
+    if (j == -1) {
+      break;
+    }
+    if (j == 0) {
+      // k < m shares a factor with m
+      return false;
+    }
+    d = d > 0 ? -(d + 2) : -d + 2;
+  }
+  int64_t q = (1 - d) / 4;
+
+  size_t n = f.n;
+  digits dm = residue(from_word(d < 0 ? -d : d), d < 0, m), qm = residue(from_word(q < 0 ? -q : q), q < 0, m);
+  f.to_montgomery(dm.data(), dm.data());
+  f.to_montgomery(qm.data(), qm.data());
+
+  // m + 1 = e 2^s
+  digits e = add_magnitude(m, digits(1, 1));
+  size_t s = strip_twos(e);
+  size_t bits = bit_length(e);
+
+  // U_k, V_k and Q^k for k the leading bits of e, starting from k = 1
+  digits u = f.one, v = f.one, qk = qm, t(n);
+  for (size_t i = bits - 1; i-- > 0; ) {
+    // U_2k = U_k V_k, V_2k = V_k^2 - 2 Q^k
+    f.mul(u.data(), u.data(), v.data());
+    f.sqr(v.data(), v.data());
+    f.add(t.data(), qk.data(), qk.data());
+    f.sub(v.data(), v.data(), t.data());
+    f.sqr(qk.data(), qk.data());
+    if ((e[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1) {
+      // U_k+1 = (U_k + V_k) / 2, V_k+1 = (D U_k + V_k) / 2
+      f.mul(t.data(), dm.data(), u.data());
+      f.add(u.data(), u.data(), v.data());
+      f.half(u.data(), u.data());
+      f.add(v.data(), t.data(), v.data());
+      f.half(v.data(), v.data());
+      f.mul(qk.data(), qk.data(), qm.data());
+    }
+  }
+  if (is_zero(u) || is_zero(v)) {
+    return true;
+  }
+  for (size_t r = 1; r < s; r++) {
+    f.sqr(v.data(), v.data());
+    f.add(t.data(), qk.data(), qk.data());
+    f.sub(v.data(), v.data(), t.data());
+    if (is_zero(v)) {
+      return true;
+    }
+    f.sqr(qk.data(), qk.data());
+  }
+  return false;
+}
+
+// Baillie-PSW test of an odd n > 2^16 without prime factors below TRIAL_DIVISION_LIMIT, whose magnitude is m,
+// followed by `rounds` Miller-Rabin tests to bases drawn from a generator seeded by n
+bool probable_prime(big_integer const& n, digits const& m, unsigned rounds) {
+  montgomery_field f(m);
+  digits d = sub_magnitude(m, digits(1, 1));
+  size_t s = strip_twos(d);
+  digits base(f.n);
+  base[0] = 2;
+  if (!miller_rabin(f, base, d, s)) {
+    return false;
+  }
+  big_integer root = isqrt(n);
+  if (root * root == n || !strong_lucas(f, m)) {
+    return false;
+  }
+
+  std::mt19937_64 gen(m[0]);
+  digits range = sub_magnitude(m, from_word(3)), random(f.n);
+  for (unsigned i = 0; i < rounds; i++) {
+    // a base in [2, m - 2]
+    for (limb& x : random) {
+      x = limb(gen());
+    }
+    digits r = random;
+    trim(r);
+    base = add_magnitude(residue(r, false, range), digits(1, 2));
+    base.resize(f.n);
+    if (!miller_rabin(f, base, d, s)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_probable_prime(big_integer const& n, unsigned rounds) {
+  if (n.sgn_ || n.eq_zero()) {
+    return false;
+  }
+  digits const& m = n.data_;
+  std::vector<uint32_t> const& primes = small_primes();
+  size_t bits = bit_length(m);
+  if (bits <= 16) {
+    return std::binary_search(primes.begin(), primes.end(), uint32_t(m[0]));
+  }
+  size_t trial = std::lower_bound(primes.begin(), primes.end(), TRIAL_DIVISION_LIMIT) - primes.begin();
+  std::vector<uint32_t> r;
+  small_residues(m, 0, trial, r);
+  if (std::find(r.begin(), r.end(), 0) != r.end()) {
+    return false;
+  }
+  if (bits <= 2 * 10) {
+    // every composite below TRIAL_DIVISION_LIMIT^2 has a factor in the table
+    return true;
+  }
+  return probable_prime(n, m, rounds);
+}
+
+big_integer next_prime(big_integer const& n) {
+  std::vector<uint32_t> const& primes = small_primes();
+  if (n < primes.back()) {
+    uint32_t x = n.sgn_ || n.eq_zero() ? 0 : uint32_t(n.data_[0]);
+    return *std::upper_bound(primes.begin(), primes.end(), x);
+  }
+
+  // candidates c + 2i for i < SIEVE_WINDOW, with r[j] = c mod primes[j + 1]
+  big_integer c = n + 1;
+  if (!(c.data_[0] & 1)) {
+    c += 1;
+  }
+  std::vector<uint32_t> r;
+  small_residues(c.data_, 1, primes.size(), r);
+  std::vector<char> composite(SIEVE_WINDOW);
+  for (;;) {
+    std::fill(composite.begin(), composite.end(), 0);
+    for (size_t j = 0; j < r.size(); j++) {
+      // the first i with c + 2i = 0 modulo p, using (p + 1) / 2 = 1 / 2
+      uint64_t p = primes[j + 1];
+      for (uint64_t i = (p - r[j]) % p * ((p + 1) / 2) % p; i < SIEVE_WINDOW; i += p) {
+        composite[i] = 1;
+      }
+    }
+    for (size_t i = 0; i < SIEVE_WINDOW; i++) {
+      if (!composite[i]) {
+        big_integer candidate = c + 2 * i;
+        if (probable_prime(candidate, candidate.data_, 0)) {
+          return candidate;
+        }
+      }
+    }
+    c += 2 * SIEVE_WINDOW;
+    for (size_t j = 0; j < r.size(); j++) {
+      r[j] = uint32_t((r[j] + 2 * SIEVE_WINDOW) % primes[j + 1]);
+    }
+  }
+}
+
+/// Decimal conversion
+
+#ifndef BIG_INTEGER_TO_STRING_THRESHOLD
+#define BIG_INTEGER_TO_STRING_THRESHOLD 24
+#endif
+
+#ifndef BIG_INTEGER_PARSE_THRESHOLD
+#define BIG_INTEGER_PARSE_THRESHOLD 16
+#endif
+
+static constexpr size_t TO_STRING_THRESHOLD = BIG_INTEGER_TO_STRING_THRESHOLD;
+static constexpr size_t PARSE_THRESHOLD = BIG_INTEGER_PARSE_THRESHOLD;
+
+// The largest power of ten that fits in a limb, 10^9 or 10^19
+static constexpr size_t DECIMAL_CHUNK_DIGITS = LIMB_BITS == 64 ? 19 : 9;
+
+constexpr limb pow10(size_t n) {
+  limb r = 1;
+  for (size_t i = 0; i < n; i++) r *= 10;
+  return r;
+}
+
+static constexpr limb DECIMAL_CHUNK = pow10(DECIMAL_CHUNK_DIGITS);
+
+// DECIMAL_CHUNK^(2^k), computed once per thread and reused by later conversions
+digits const& decimal_power(size_t k) {
+  thread_local std::deque<digits> powers(1, digits(1, DECIMAL_CHUNK));
+  while (powers.size() <= k) {
+    powers.push_back(multiply(powers.back(), powers.back()));
+  }
+  return powers[k];
+}
+
+// Writes the digits of a into out[0, width), padding with leading zeroes
+void write_decimal_basecase(digits a, char* out, size_t width) {
+  size_t pos = width;
+  while (!a.empty()) {
+    limb chunk = divide_limb(a, DECIMAL_CHUNK);
+    for (size_t i = 0; i < DECIMAL_CHUNK_DIGITS && pos > 0; i++) {
+      out[--pos] = char('0' + chunk % 10);
+      chunk /= 10;
+    }
+  }
+  std::fill(out, out + pos, '0');
+}
+
+// Same as write_decimal_basecase, but splits a by the cached power of DECIMAL_CHUNK
+// that is a quarter to a half of its length and converts both halves recursively
+void write_decimal(digits const& a, char* out, size_t width) {
+  if (a.size() < TO_STRING_THRESHOLD) {
+    write_decimal_basecase(a, out, width);
+    return;
+  }
+  size_t k = 0;
+  while (4 * decimal_power(k).size() <= a.size()) k++;
+  size_t low_width = DECIMAL_CHUNK_DIGITS << k;
+  digits q, r;
+  divide(a, decimal_power(k), q, r);
+  write_decimal(q, out, width - low_width);
+  write_decimal(r, out + width - low_width, low_width);
+}
+
+// a = a * m + c
+void mul_add_limb(digits& a, limb m, limb c) {
+  double_limb carry = c;
+  for (limb& x : a) {
+    double_limb tmp = double_limb(x) * m + carry;
+    x = cast_to_limb(tmp);
+    carry = tmp >> LIMB_BITS;
+  }
+  if (carry != 0) {
+    a.push_back(cast_to_limb(carry));
+  }
+}
+
+limb parse_chunk(char const* first, char const* last) {
+  limb r = 0;
+  for (; first != last; first++) {
+    r = r * 10 + limb(*first - '0');
+  }
+  return r;
+}
+
+// Parses [first, last) in DECIMAL_CHUNK_DIGITS groups. Short inputs are accumulated with Horner's scheme,
+// long ones combine adjacent groups pairwise, level k multiplying by DECIMAL_CHUNK^(2^k)
+digits parse_decimal(char const* first, char const* last) {
+  // one branch-free pass the compiler can vectorize, instead of a check per digit
+  bool bad = false;
+  for (char const* it = first; it != last; it++) {
+    bad |= static_cast<unsigned char>(*it - '0') > 9;
+  }
+  if (bad) {
+    throw std::invalid_argument("Error while parsing number");
+  }
+  size_t n = last - first;
+  size_t chunks = (n + DECIMAL_CHUNK_DIGITS - 1) / DECIMAL_CHUNK_DIGITS;
+  if (chunks < PARSE_THRESHOLD) {
+    size_t head = n - (chunks - 1) * DECIMAL_CHUNK_DIGITS;
+    digits r;
+    mul_add_limb(r, 1, parse_chunk(first, first + head));
+    for (char const* it = first + head; it != last; it += DECIMAL_CHUNK_DIGITS) {
+      mul_add_limb(r, DECIMAL_CHUNK, parse_chunk(it, it + DECIMAL_CHUNK_DIGITS));
+    }
+    return r;
+  }
+  // level[i] holds the value of the i-th group of 2^k chunks, least significant first
+  std::vector<digits> level(chunks);
+  for (size_t i = 0; i < chunks; i++) {
+    char const* chunk_last = last - i * DECIMAL_CHUNK_DIGITS;
+    char const* chunk_first = i + 1 == chunks ? first : chunk_last - DECIMAL_CHUNK_DIGITS;
+    limb x = parse_chunk(chunk_first, chunk_last);
+    if (x != 0) {
+      level[i].push_back(x);
+    }
+  }
+  for (size_t k = 0; level.size() > 1; k++) {
+    digits const& p = decimal_power(k);
+    for (size_t i = 0; 2 * i < level.size(); i++) {
+      if (2 * i + 1 < level.size()) {
+        level[i] = add_magnitude(multiply(level[2 * i + 1], p), level[2 * i]);
+      } else {
+        level[i] = std::move(level[2 * i]);
+      }
+    }
+    level.resize((level.size() + 1) / 2);
+  }
+  return std::move(level[0]);
+}
+
+std::string to_string(big_integer const& a) {
+  if (a.data_.empty()) {
+    return "0";
+  }
+  // an upper bound on the number of digits: log10(2) < 0.30103
+  size_t width = a.size() * LIMB_BITS * 30103 / 100000 + 1;
+  std::string ans(width, '0');
+  write_decimal(a.data_, &ans[0], width);
+  ans.erase(0, std::min(ans.find_first_not_of('0'), width - 1));
+  if (a.sgn_) {
+    ans.insert(ans.begin(), '-');
+  }
+  return ans;
+}
+
+std::ostream& operator<<(std::ostream& s, big_integer const& a) {
+  return s << to_string(a);
+}
+
+size_t big_integer::size() const {
+  return data_.size();
+}
+
+/// Private
+
+bool big_integer::eq_zero() const {
+  return data_.empty();
+}
+
+void big_integer::negate() {
+  sgn_ = !sgn_ && !eq_zero();
+}
+
+big_integer& big_integer::shl_bits(uint64_t shift) {
+  if (eq_zero()) {
+    return *this;
+  }
+  size_t n = size(), whole = shift / LIMB_BITS;
+  data_.resize(n + whole + 1);
+  limb* d = data_.data();
+  d[n + whole] = kernels().shl_n(d + whole, d, n, shift % LIMB_BITS);
+  std::fill(d, d + whole, 0);
+  return delete_leading_zeroes();
+}
+
+// Shifts right with floor semantics, as on the two's complement form:
+// a negative value whose dropped bits are not all zero moves one further from zero
+big_integer& big_integer::shr_bits(uint64_t shift) {
+  size_t n = size();
+  if (shift / LIMB_BITS >= n) {
+    data_.clear();
+    if (sgn_) {
+      data_.push_back(1);
+    }
+    return *this;
+  }
+  size_t whole = shift / LIMB_BITS;
+  unsigned mod = shift % LIMB_BITS;
+  limb* d = data_.data();
+  bool round = sgn_ && (std::any_of(d, d + whole, [](limb x) { return x != 0; }) ||
+                        (mod != 0 && limb(d[whole] << (LIMB_BITS - mod)) != 0));
+  kernels().shr_n(d, d + whole, n - whole, mod);
+  data_.resize(n - whole);
+  trim(data_);
+  if (round) {
+    increment(data_);
+  }
+  return delete_leading_zeroes();
+}
+
+// this += (b_sgn ? -|b| : |b|); b may be this
+big_integer& big_integer::add_signed(big_integer const& b, bool b_sgn) {
+  size_t an = size(), bn = b.size();
+  if (sgn_ == b_sgn) {
+    size_t n = std::max(an, bn);
+    data_.resize(n + 1);
+    limb* r = data_.data();
+    limb const* y = b.data_.data();
+    r[n] = an >= bn ? add_n(r, r, an, y, bn) : add_n(r, y, bn, r, an);
+    return delete_leading_zeroes();
+  }
+  int cmp = compare_magnitude(data_, b.data_);
+  if (cmp == 0) {
+    data_.clear();
+    sgn_ = false;
+    return *this;
+  }
+  if (cmp > 0) {
+    sub_n(data_.data(), data_.data(), an, b.data_.data(), bn);
+  } else {
+    data_.resize(bn);
+    sub_n(data_.data(), b.data_.data(), bn, data_.data(), an);
+    sgn_ = b_sgn;
+  }
+  return delete_leading_zeroes();
+}
+
+// Bitwise operators act on the infinite two's complement form. A negative magnitude m is read
+// limb by limb as ~m + 1 and a negative result is turned back into a magnitude the same way,
+// so no operand is negated up front. Non-negative operands go straight to the vectorized kernels.
+template <typename Op>
+big_integer& big_integer::bit_operation(big_integer const& b) {
+  Op op;
+  size_t an = size(), bn = b.size(), n = std::max(an, bn);
+  if (!sgn_ && !b.sgn_) {
+    data_.resize(n);
+    limb* r = data_.data();
+    limb const* y = b.data_.data();
+    bitwise_n(op, r, r, y, bn);
+    for (size_t i = bn; i < n; i++) {
+      r[i] = op(r[i], limb(0));
+    }
+    return delete_leading_zeroes();
+  }
+  limb fa = sgn_ ? LIMB_MAX : 0, fb = b.sgn_ ? LIMB_MAX : 0, fr = op(fa, fb);
+  limb ca = fa & 1, cb = fb & 1, cr = fr & 1;
+  data_.resize(n + 1);
+  limb* r = data_.data();
+  limb const* y = b.data_.data();
+  for (size_t i = 0; i <= n; i++) {
+    limb x = (r[i] ^ fa) + ca;
+    ca = x < ca;
+    limb z = ((i < bn ? y[i] : 0) ^ fb) + cb;
+    cb = z < cb;
+    limb w = (op(x, z) ^ fr) + cr;
+    cr = w < cr;
+    r[i] = w;
+  }
+  sgn_ = fr != 0;
+  return delete_leading_zeroes();
+}
 
+big_integer& big_integer::delete_leading_zeroes() {
+  trim(data_);
+  if (data_.empty()) {
+    sgn_ = false;
+  }
+  return *this;
+}
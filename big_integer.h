@@ -1,14 +1,30 @@
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 #include <string>
-#include <vector>
+#include <type_traits>
+#include <utility>
 #include <ostream>
-#include <functional>
+#include <vector>
+
+#include "small_vector.h"
 
 struct big_integer {
+#ifdef BIG_INTEGER_64BIT_LIMBS
+  typedef uint64_t limb;
+#else
+  typedef uint32_t limb;
+#endif
+  // magnitudes up to 16 bytes are kept inside the object without a heap allocation
+  typedef small_vector<limb, 16 / sizeof(limb)> limb_vector;
+  // native integers that arithmetic and comparisons take directly, without converting them to a big_integer
+  template <typename T>
+  using if_native = typename std::enable_if<std::is_integral<T>::value && sizeof(T) <= sizeof(uint64_t), int>::type;
+
   big_integer();
   big_integer(big_integer const& other);
+  big_integer(big_integer&& other) noexcept;
   big_integer(int a);
   big_integer(unsigned a);
   big_integer(long a);
@@ -19,6 +35,26 @@ struct big_integer {
   ~big_integer();
 
   big_integer& operator=(big_integer const& other);
+  big_integer& operator=(big_integer&& other) noexcept;
+
+  // expressions built by big_integer_expr.h are evaluated straight into this object's storage
+  template <typename E, typename = typename E::big_integer_expression>
+  big_integer(E const& e) : big_integer() {
+    e.evaluate(*this);
+  }
+  template <typename E, typename = typename E::big_integer_expression>
+  big_integer& operator=(E const& e) {
+    return e.evaluate(*this);
+  }
+
+  // A term of a linear combination: a * b, or a alone when b is null
+  struct term {
+    big_integer const* a;
+    big_integer const* b;
+    bool negative;
+  };
+  // this = the sum of terms[0, n), added up limb by limb in a single carry pass; the terms may refer to this
+  big_integer& assign_terms(term const* terms, size_t n);
 
   big_integer& operator+=(big_integer const& rhs);
   big_integer& operator-=(big_integer const& rhs);
@@ -26,12 +62,43 @@ struct big_integer {
   big_integer& operator/=(big_integer const& rhs);
   big_integer& operator%=(big_integer const& rhs);
 
+  // Native operands never allocate a temporary; a carry or borrow stops as soon as it is absorbed,
+  // so small updates of a large value take amortized constant time
+  template <typename T, if_native<T> = 0>
+  big_integer& operator+=(T rhs) {
+    return add_word(magnitude(rhs), rhs < T(0));
+  }
+  template <typename T, if_native<T> = 0>
+  big_integer& operator-=(T rhs) {
+    return add_word(magnitude(rhs), !(rhs < T(0)));
+  }
+  template <typename T, if_native<T> = 0>
+  big_integer& operator*=(T rhs) {
+    return mul_word(magnitude(rhs), rhs < T(0));
+  }
+  template <typename T, if_native<T> = 0>
+  big_integer& operator/=(T rhs) {
+    return div_word(magnitude(rhs), rhs < T(0), false);
+  }
+  template <typename T, if_native<T> = 0>
+  big_integer& operator%=(T rhs) {
+    return div_word(magnitude(rhs), rhs < T(0), true);
+  }
+
   big_integer& operator&=(big_integer const& rhs);
   big_integer& operator|=(big_integer const& rhs);
   big_integer& operator^=(big_integer const& rhs);
 
-  big_integer& operator<<=(int rhs);
-  big_integer& operator>>=(int rhs);
+  // Shifts by any native count, negative counts shift the other way. Both work in place: a whole-limb move and
+  // one funnel-shift pass, reallocating only when a left shift outgrows the capacity
+  template <typename T, if_native<T> = 0>
+  big_integer& operator<<=(T rhs) {
+    return rhs < T(0) ? shr_bits(magnitude(rhs)) : shl_bits(magnitude(rhs));
+  }
+  template <typename T, if_native<T> = 0>
+  big_integer& operator>>=(T rhs) {
+    return rhs < T(0) ? shl_bits(magnitude(rhs)) : shr_bits(magnitude(rhs));
+  }
 
   big_integer operator+() const;
   big_integer operator-() const;
@@ -50,27 +117,159 @@ struct big_integer {
   friend bool operator<=(big_integer const& a, big_integer const& b);
   friend bool operator>=(big_integer const& a, big_integer const& b);
 
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator+(big_integer a, T b) {
+    a += b;
+    return a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator+(T a, big_integer b) {
+    b += a;
+    return b;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator-(big_integer a, T b) {
+    a -= b;
+    return a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator-(T a, big_integer b) {
+    b.negate();
+    b += a;
+    return b;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator*(big_integer a, T b) {
+    a *= b;
+    return a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator*(T a, big_integer b) {
+    b *= a;
+    return b;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator/(big_integer a, T b) {
+    a /= b;
+    return a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator%(big_integer a, T b) {
+    a %= b;
+    return a;
+  }
+
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator<<(big_integer a, T b) {
+    a <<= b;
+    return a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend big_integer operator>>(big_integer a, T b) {
+    a >>= b;
+    return a;
+  }
+
+  template <typename T, if_native<T> = 0>
+  friend bool operator==(big_integer const& a, T b) {
+    return a.compare_word(magnitude(b), b < T(0)) == 0;
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator==(T a, big_integer const& b) {
+    return b == a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator!=(big_integer const& a, T b) {
+    return !(a == b);
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator!=(T a, big_integer const& b) {
+    return !(b == a);
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator<(big_integer const& a, T b) {
+    return a.compare_word(magnitude(b), b < T(0)) < 0;
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator<(T a, big_integer const& b) {
+    return b.compare_word(magnitude(a), a < T(0)) > 0;
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator>(big_integer const& a, T b) {
+    return b < a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator>(T a, big_integer const& b) {
+    return b < a;
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator<=(big_integer const& a, T b) {
+    return !(b < a);
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator<=(T a, big_integer const& b) {
+    return !(b < a);
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator>=(big_integer const& a, T b) {
+    return !(a < b);
+  }
+  template <typename T, if_native<T> = 0>
+  friend bool operator>=(T a, big_integer const& b) {
+    return !(a < b);
+  }
+
+  friend void divmod(big_integer const& a, big_integer const& b, big_integer& q, big_integer& r);
+
+  friend big_integer square(big_integer const& a);
+
+  friend void addmul(big_integer& acc, big_integer const& a, big_integer const& b);
+  friend void submul(big_integer& acc, big_integer const& a, big_integer const& b);
+  template <typename T, if_native<T> = 0>
+  friend void addmul(big_integer& acc, big_integer const& a, T b) {
+    acc.addmul_word(a, magnitude(b), b < T(0), false);
+  }
+  template <typename T, if_native<T> = 0>
+  friend void submul(big_integer& acc, big_integer const& a, T b) {
+    acc.addmul_word(a, magnitude(b), b < T(0), true);
+  }
+  friend big_integer pow_mod(big_integer const& a, big_integer const& e, big_integer const& m);
+  friend struct montgomery_context;
+  friend struct modulus;
+  friend big_integer pow(big_integer const& a, unsigned e);
+  friend big_integer iroot(big_integer const& a, unsigned k);
+  friend big_integer gcd(big_integer const& a, big_integer const& b);
+  friend void extended_gcd(big_integer const& a, big_integer const& b, big_integer& g, big_integer& x, big_integer& y);
+  friend bool is_probable_prime(big_integer const& n, unsigned rounds);
+  friend big_integer next_prime(big_integer const& n);
+
   friend std::string to_string(big_integer const& a);
 
 private:
-  std::vector<uint32_t> data_;
+  // sign and magnitude: data_ holds |value| without leading zero limbs, sgn_ is set only for negative values
+  limb_vector data_;
   bool sgn_;
 
-  void push(uint32_t x);
   size_t size() const;
   bool eq_zero() const;
-  big_integer abs() const;
-  void expand(size_t x, uint32_t y);
-  uint32_t get_zero() const;
-  std::vector<uint32_t> div_uint32_t(uint32_t x) const;
-  uint32_t operator[](size_t ind) const;
-  big_integer& norm();
-  big_integer& delete_leading_zeroes();
-  big_integer& bit_operation(std::function<uint32_t(uint32_t, uint32_t)> const& f, big_integer const& b);
+  big_integer& add_signed(big_integer const& b, bool b_sgn);
+  void negate();
 
-  static const std::function<uint32_t(uint32_t, uint32_t)> bit_and;
-  static const std::function<uint32_t(uint32_t, uint32_t)> bit_xor;
-  static const std::function<uint32_t(uint32_t, uint32_t)> bit_or;
+  template <typename T>
+  static uint64_t magnitude(T x) {
+    return x < T(0) ? 0 - uint64_t(x) : uint64_t(x);
+  }
+  big_integer& add_word(uint64_t w, bool w_sgn);
+  big_integer& mul_word(uint64_t w, bool w_sgn);
+  big_integer& div_word(uint64_t w, bool w_sgn, bool remainder);
+  int compare_word(uint64_t w, bool w_sgn) const;
+  void addmul_limbs(big_integer const& a, limb const* b, size_t bn, bool b_sgn, bool subtract);
+  void addmul_word(big_integer const& a, uint64_t w, bool w_sgn, bool subtract);
+  big_integer& shl_bits(uint64_t shift);
+  big_integer& shr_bits(uint64_t shift);
+  big_integer& delete_leading_zeroes();
+  template <typename Op>
+  big_integer& bit_operation(big_integer const& b);
 };
 
 big_integer operator+(big_integer a, big_integer const& b);
@@ -83,8 +282,12 @@ big_integer operator&(big_integer a, big_integer const& b);
 big_integer operator|(big_integer a, big_integer const& b);
 big_integer operator^(big_integer a, big_integer const& b);
 
-big_integer operator<<(big_integer a, int b);
-big_integer operator>>(big_integer a, int b);
+// commutative operators reuse the storage of a temporary right operand
+big_integer operator+(big_integer const& a, big_integer&& b);
+big_integer operator*(big_integer const& a, big_integer&& b);
+big_integer operator&(big_integer const& a, big_integer&& b);
+big_integer operator|(big_integer const& a, big_integer&& b);
+big_integer operator^(big_integer const& a, big_integer&& b);
 
 bool operator==(big_integer const& a, big_integer const& b);
 bool operator!=(big_integer const& a, big_integer const& b);
@@ -93,6 +296,85 @@ bool operator>(big_integer const& a, big_integer const& b);
 bool operator<=(big_integer const& a, big_integer const& b);
 bool operator>=(big_integer const& a, big_integer const& b);
 
+// Quotient rounded towards zero and remainder with the sign of a, both from a single division.
+// q and r may alias a or b, but not each other
+void divmod(big_integer const& a, big_integer const& b, big_integer& q, big_integer& r);
+std::pair<big_integer, big_integer> divmod(big_integer const& a, big_integer const& b);
+
+// a * a at about half the cost of a general multiplication; a *= a takes the same path
+big_integer square(big_integer const& a);
+
+// acc += a * b and acc -= a * b, accumulating the partial products straight into acc's limbs instead of
+// building the product first; b may also be a native integer
+void addmul(big_integer& acc, big_integer const& a, big_integer const& b);
+void submul(big_integer& acc, big_integer const& a, big_integer const& b);
+
+// a^e by binary exponentiation on the squaring path; pow(0, 0) = 1
+big_integer pow(big_integer const& a, unsigned e);
+// floor(sqrt(a)) for a >= 0
+big_integer isqrt(big_integer const& a);
+// The k-th root of a rounded towards zero, k >= 1; a may be negative only for odd k
+big_integer iroot(big_integer const& a, unsigned k);
+
+// Greatest common divisor of |a| and |b| by Lehmer's algorithm; gcd(0, 0) = 0
+big_integer gcd(big_integer const& a, big_integer const& b);
+// g = gcd(a, b) with Bezout coefficients a * x + b * y = g. The outputs may alias the inputs
+void extended_gcd(big_integer const& a, big_integer const& b, big_integer& g, big_integer& x, big_integer& y);
+// x in [0, |m|) with a * x = 1 mod m; throws std::invalid_argument unless gcd(a, m) = 1
+big_integer mod_inverse(big_integer const& a, big_integer const& m);
+
+// Whether n is prime, false for n < 2: trial division, then the Baillie-PSW test (no known counterexamples)
+// and `rounds` extra Miller-Rabin rounds to pseudo-random bases. Exact below 2^64
+bool is_probable_prime(big_integer const& n, unsigned rounds = 0);
+// The smallest probable prime greater than n, searched with a sieve over small primes
+big_integer next_prime(big_integer const& n);
+
+// a^e mod |m| in [0, |m|) for e >= 0; odd moduli go through Montgomery multiplication
+big_integer pow_mod(big_integer const& a, big_integer const& e, big_integer const& m);
+
+// Montgomery arithmetic modulo a fixed odd m, set up once for any number of calls.
+// Operands may be negative or exceed m, results are in [0, |m|)
+struct montgomery_context {
+  explicit montgomery_context(big_integer const& m);
+
+  big_integer const& modulus() const;
+  big_integer mul_mod(big_integer const& a, big_integer const& b) const;
+  big_integer pow_mod(big_integer const& a, big_integer const& e) const;
+
+private:
+  big_integer m_;
+  // -m^-1 modulo the limb base B, and R^2 mod m for R = B^n with n limbs in m
+  big_integer::limb m_inv_;
+  big_integer::limb_vector r2_;
+};
+
+// Reduction modulo a fixed m != 0. The normalized divisor and its Barrett reciprocal are computed once,
+// so repeated reductions skip that setup and, for large m, the long division as well.
+// Operands may be negative or exceed m, results are in [0, |m|)
+struct modulus {
+  explicit modulus(big_integer const& m);
+
+  big_integer const& value() const;
+  big_integer reduce(big_integer const& a) const;
+  big_integer mul_mod(big_integer const& a, big_integer const& b) const;
+  big_integer add_mod(big_integer const& a, big_integer const& b) const;
+
+private:
+  big_integer m_;
+  // v_ = m << shift_ has its top bit set, mu_ = B^2n / v_ for the limb base B and n limbs in m
+  unsigned shift_;
+  big_integer::limb_vector v_;
+  big_integer::limb_vector mu_;
+};
+
 std::string to_string(big_integer const& a);
 std::ostream& operator<<(std::ostream& s, big_integer const& a);
 
+// Runtime selection of the limb kernels. At startup the fastest set this CPU supports is bound,
+// or the one named by the BIG_INTEGER_KERNELS environment variable. "portable" is always available.
+// Switching sets while other threads are doing arithmetic is safe, results do not depend on the set.
+namespace big_integer_kernels {
+std::vector<std::string> available();
+std::string current();
+bool select(std::string const& name);
+}
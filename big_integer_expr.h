@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "big_integer.h"
+
+// Opt-in expression templates. An operation with an operand wrapped in lazy(), or with an expression, builds an
+// expression tree instead of a big_integer; assigning the tree to a big_integer evaluates it into that object's
+// storage:
+//
+//   r = lazy(a) * b + lazy(c) * d - e;
+//
+// The tree is flattened into a sum of values and products of two values. Each product goes to a per-thread
+// buffer and the whole sum is added up in one carry pass straight into r, so no intermediate big_integer is
+// allocated. A factor that is itself a sum or a longer product is evaluated into a temporary first.
+// The tree refers to its operands, which must outlive it; r may be one of them.
+namespace big_integer_expr {
+
+template <typename E>
+struct expression {
+  typedef void big_integer_expression;
+
+  E const& self() const {
+    return static_cast<E const&>(*this);
+  }
+
+  big_integer& evaluate(big_integer& r) const {
+    std::array<big_integer::term, E::terms> t;
+    self().collect(t.data(), false);
+    return r.assign_terms(t.data(), t.size());
+  }
+};
+
+struct value : expression<value> {
+  static constexpr size_t terms = 1;
+
+  explicit value(big_integer const& a) : a(&a) {}
+
+  void collect(big_integer::term* out, bool negative) const {
+    *out = {a, nullptr, negative};
+  }
+
+  big_integer const* factor() const {
+    return a;
+  }
+
+private:
+  big_integer const* a;
+};
+
+template <typename E>
+big_integer const* factor_of(E const& e, big_integer& temporary) {
+  e.evaluate(temporary);
+  return &temporary;
+}
+
+inline big_integer const* factor_of(value const& e, big_integer&) {
+  return e.factor();
+}
+
+template <typename L, typename R, bool Minus>
+struct sum : expression<sum<L, R, Minus>> {
+  static constexpr size_t terms = L::terms + R::terms;
+
+  sum(L const& l, R const& r) : l(l), r(r) {}
+
+  void collect(big_integer::term* out, bool negative) const {
+    l.collect(out, negative);
+    r.collect(out + L::terms, negative != Minus);
+  }
+
+private:
+  L l;
+  R r;
+};
+
+template <typename E>
+struct negation : expression<negation<E>> {
+  static constexpr size_t terms = E::terms;
+
+  explicit negation(E const& e) : e(e) {}
+
+  void collect(big_integer::term* out, bool negative) const {
+    e.collect(out, !negative);
+  }
+
+private:
+  E e;
+};
+
+template <typename L, typename R>
+struct product : expression<product<L, R>> {
+  static constexpr size_t terms = 1;
+
+  product(L const& l, R const& r) : l(l), r(r) {}
+
+  void collect(big_integer::term* out, bool negative) const {
+    *out = {factor_of(l, l_value), factor_of(r, r_value), negative};
+  }
+
+private:
+  L l;
+  R r;
+  // factors that are not plain values, evaluated while the expression is collected
+  mutable big_integer l_value, r_value;
+};
+
+inline value lazy(big_integer const& a) {
+  return value(a);
+}
+
+template <typename L, typename R>
+sum<L, R, false> operator+(expression<L> const& l, expression<R> const& r) {
+  return {l.self(), r.self()};
+}
+
+template <typename L>
+sum<L, value, false> operator+(expression<L> const& l, big_integer const& r) {
+  return {l.self(), value(r)};
+}
+
+template <typename R>
+sum<value, R, false> operator+(big_integer const& l, expression<R> const& r) {
+  return {value(l), r.self()};
+}
+
+// big_integer has + and * overloads for a temporary operand, these outrank them for temporaries next to an
+// expression. The temporary lives until the end of the full expression, like any other operand
+template <typename L>
+sum<L, value, false> operator+(expression<L> const& l, big_integer&& r) {
+  return {l.self(), value(r)};
+}
+
+template <typename R>
+sum<value, R, false> operator+(big_integer&& l, expression<R> const& r) {
+  return {value(l), r.self()};
+}
+
+template <typename L, typename R>
+sum<L, R, true> operator-(expression<L> const& l, expression<R> const& r) {
+  return {l.self(), r.self()};
+}
+
+template <typename L>
+sum<L, value, true> operator-(expression<L> const& l, big_integer const& r) {
+  return {l.self(), value(r)};
+}
+
+template <typename R>
+sum<value, R, true> operator-(big_integer const& l, expression<R> const& r) {
+  return {value(l), r.self()};
+}
+
+template <typename E>
+negation<E> operator-(expression<E> const& e) {
+  return negation<E>(e.self());
+}
+
+template <typename L, typename R>
+product<L, R> operator*(expression<L> const& l, expression<R> const& r) {
+  return {l.self(), r.self()};
+}
+
+template <typename L>
+product<L, value> operator*(expression<L> const& l, big_integer const& r) {
+  return {l.self(), value(r)};
+}
+
+template <typename R>
+product<value, R> operator*(big_integer const& l, expression<R> const& r) {
+  return {value(l), r.self()};
+}
+
+template <typename L>
+product<L, value> operator*(expression<L> const& l, big_integer&& r) {
+  return {l.self(), value(r)};
+}
+
+template <typename R>
+product<value, R> operator*(big_integer&& l, expression<R> const& r) {
+  return {value(l), r.self()};
+}
+
+} // namespace big_integer_expr
@@ -59,6 +59,16 @@ struct big_integer_gmp
     friend bool operator<=(big_integer_gmp const& a, big_integer_gmp const& b);
     friend bool operator>=(big_integer_gmp const& a, big_integer_gmp const& b);
 
+    friend big_integer_gmp pow_mod(big_integer_gmp const& a, big_integer_gmp const& e, big_integer_gmp const& m);
+
+    friend big_integer_gmp iroot(big_integer_gmp const& a, unsigned k);
+big_integer_gmp gcd(big_integer_gmp const& a, big_integer_gmp const& b);
+bool is_probable_prime(big_integer_gmp const& n);
+big_integer_gmp next_prime(big_integer_gmp const& n);
+    friend big_integer_gmp gcd(big_integer_gmp const& a, big_integer_gmp const& b);
+    friend bool is_probable_prime(big_integer_gmp const& n);
+    friend big_integer_gmp next_prime(big_integer_gmp const& n);
+
     friend std::string to_string(big_integer_gmp const& a);
 
 private:
@@ -85,5 +95,9 @@ bool operator>(big_integer_gmp const& a, big_integer_gmp const& b);
 bool operator<=(big_integer_gmp const& a, big_integer_gmp const& b);
 bool operator>=(big_integer_gmp const& a, big_integer_gmp const& b);
 
+big_integer_gmp pow_mod(big_integer_gmp const& a, big_integer_gmp const& e, big_integer_gmp const& m);
+
+big_integer_gmp iroot(big_integer_gmp const& a, unsigned k);
+
 std::string to_string(big_integer_gmp const& a);
 std::ostream& operator<<(std::ostream& s, big_integer_gmp const& a);
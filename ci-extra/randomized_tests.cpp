@@ -279,3 +279,192 @@ TEST(correctness_random, bit_shifts)
         EXPECT_EQ(to_string(a >> shift), to_string(R >> shift));
     }
 }
+
+TEST(correctness_random, mul_large)
+{
+    std::default_random_engine rng(42);
+    for (size_t size : {MAX_SIZE * 2, MAX_SIZE * 8, MAX_SIZE * 32, MAX_SIZE * 64})
+    {
+        big_integer_gmp a, b;
+        a.random(size, rng);
+        b.random(size - rng() % (size / 2), rng);
+        big_integer A = big_integer(to_string(a));
+        big_integer B = big_integer(to_string(b));
+        EXPECT_EQ(to_string(a * b), to_string(A * B));
+        EXPECT_EQ(to_string(b * a), to_string(B * A));
+        EXPECT_EQ(to_string(a * a), to_string(A * A));
+    }
+}
+
+TEST(correctness_random, square)
+{
+    std::default_random_engine rng(7);
+    for (size_t size : {size_t(64), size_t(1500), size_t(3000), MAX_SIZE * 4, MAX_SIZE * 32})
+    {
+        big_integer_gmp a;
+        a.random(size, rng);
+        big_integer A = big_integer(to_string(a));
+        EXPECT_EQ(to_string(a * a), to_string(square(A)));
+        A *= A;
+        EXPECT_EQ(to_string(a * a), to_string(A));
+    }
+}
+
+TEST(correctness_random, pow_mod)
+{
+    std::default_random_engine rng(2048);
+    for (size_t size : {size_t(30), size_t(64), size_t(500), MAX_SIZE, MAX_SIZE * 2})
+    {
+        for (size_t itn = 0; itn != NUMBER_OF_ITERATIONS; ++itn)
+        {
+            big_integer_gmp a, e, m;
+            a.random(2 * size, rng);
+            e.random(size, rng);
+            m.random(size, rng);
+            e = e < 0 ? -e : e;
+            m = m < 0 ? -m : m;
+            // alternate between odd (Montgomery) and even moduli
+            m = (m >> 1 << 1) + big_integer_gmp(int(itn % 2));
+            if (m == 0)
+            {
+                continue;
+            }
+            big_integer A = big_integer(to_string(a));
+            big_integer E = big_integer(to_string(e));
+            big_integer M = big_integer(to_string(m));
+            EXPECT_EQ(to_string(pow_mod(a, e, m)), to_string(pow_mod(A, E, M)));
+        }
+    }
+}
+
+TEST(correctness_random, modulus)
+{
+    std::default_random_engine rng(17);
+    for (size_t size : {size_t(40), size_t(700), MAX_SIZE, MAX_SIZE * 4})
+    {
+        big_integer_gmp m;
+        m.random(size, rng);
+        if (m == 0)
+        {
+            continue;
+        }
+        big_integer_gmp am = m < 0 ? -m : m;
+        big_integer M = big_integer(to_string(m));
+        modulus mod(M);
+        for (size_t itn = 0; itn != NUMBER_OF_ITERATIONS; ++itn)
+        {
+            big_integer_gmp a, b;
+            a.random(size * (1 + itn % 5), rng);
+            b.random(size, rng);
+            big_integer A = big_integer(to_string(a));
+            big_integer B = big_integer(to_string(b));
+            EXPECT_EQ(to_string((a % am + am) % am), to_string(mod.reduce(A)));
+            EXPECT_EQ(to_string((a * b % am + am) % am), to_string(mod.mul_mod(A, B)));
+            EXPECT_EQ(to_string(((a + b) % am + am) % am), to_string(mod.add_mod(A, B)));
+        }
+    }
+}
+
+TEST(correctness_random, iroot)
+{
+    std::default_random_engine rng(99);
+    for (size_t size : {size_t(50), size_t(200), MAX_SIZE, MAX_SIZE * 16})
+    {
+        for (unsigned k : {2u, 3u, 4u, 7u, 31u})
+        {
+            big_integer_gmp a;
+            a.random(size, rng);
+            a = a < 0 ? -a : a;
+            big_integer A = big_integer(to_string(a));
+            EXPECT_EQ(to_string(iroot(a, k)), to_string(iroot(A, k)));
+            EXPECT_EQ(to_string(iroot(a * a, 2)), to_string(isqrt(A * A)));
+        }
+    }
+}
+
+TEST(correctness_random, gcd)
+{
+    std::default_random_engine rng(5);
+    for (size_t size : {size_t(40), size_t(100), size_t(700), MAX_SIZE, MAX_SIZE * 8})
+    {
+        for (size_t itn = 0; itn != NUMBER_OF_ITERATIONS; ++itn)
+        {
+            big_integer_gmp a, b, c;
+            a.random(size, rng);
+            b.random(size - rng() % (size / 2), rng);
+            c.random(size / 4, rng);
+            // a common factor makes the result non-trivial
+            a *= c;
+            b *= c;
+            big_integer A = big_integer(to_string(a));
+            big_integer B = big_integer(to_string(b));
+            big_integer G, X, Y;
+            EXPECT_EQ(to_string(gcd(a, b)), to_string(gcd(A, B)));
+            extended_gcd(A, B, G, X, Y);
+            EXPECT_EQ(to_string(gcd(a, b)), to_string(G));
+            EXPECT_EQ(G, A * X + B * Y);
+        }
+    }
+}
+
+TEST(correctness_random, addmul)
+{
+    std::default_random_engine rng(11);
+    for (size_t size : {size_t(40), size_t(300), MAX_SIZE, MAX_SIZE * 8})
+    {
+        for (size_t itn = 0; itn != NUMBER_OF_ITERATIONS; ++itn)
+        {
+            big_integer_gmp acc, a, b;
+            acc.random(size + rng() % size, rng);
+            a.random(size - rng() % (size / 2), rng);
+            b.random(size - rng() % (size / 2), rng);
+            big_integer ACC = big_integer(to_string(acc));
+            big_integer A = big_integer(to_string(a));
+            big_integer B = big_integer(to_string(b));
+            big_integer X = ACC, Y = ACC;
+            addmul(X, A, B);
+            submul(Y, A, B);
+            EXPECT_EQ(to_string(acc + a * b), to_string(X));
+            EXPECT_EQ(to_string(acc - a * b), to_string(Y));
+        }
+    }
+}
+
+TEST(correctness_random, primes)
+{
+    std::default_random_engine rng(7);
+    for (size_t size : {size_t(10), size_t(64), size_t(300), size_t(1024)})
+    {
+        for (size_t itn = 0; itn != NUMBER_OF_ITERATIONS; ++itn)
+        {
+            big_integer_gmp a, b;
+            a.random(size, rng);
+            b.random(size / 2, rng);
+            big_integer A = big_integer(to_string(a));
+            big_integer P = next_prime(A);
+            EXPECT_EQ(to_string(next_prime(a)), to_string(P));
+            EXPECT_TRUE(is_probable_prime(P));
+            EXPECT_EQ(A > 0 && is_probable_prime(a), is_probable_prime(A));
+            // products of primes must not pass
+            EXPECT_FALSE(is_probable_prime(P * next_prime(big_integer(to_string(b)))));
+        }
+    }
+}
+
+TEST(correctness_random, div_large)
+{
+    std::default_random_engine rng(322);
+    for (size_t size : {MAX_SIZE * 4, MAX_SIZE * 16, MAX_SIZE * 64})
+    {
+        for (size_t divisor_size : {size / 8, size / 3, size / 2, size - 40})
+        {
+            big_integer_gmp a, b;
+            a.random(size, rng);
+            b.random(divisor_size, rng);
+            big_integer A = big_integer(to_string(a));
+            big_integer B = big_integer(to_string(b));
+            EXPECT_EQ(to_string(a / b), to_string(A / B));
+            EXPECT_EQ(to_string(a % b), to_string(A % B));
+        }
+    }
+}
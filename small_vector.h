@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#ifdef BIG_INTEGER_ALLOCATION_TIMING
+#include <chrono>
+#endif
+
+// Heap storage of small_vector. Buffers are requested in size classes, four per power of two, so that a block
+// freed by one vector fits the next vector of a similar size, and come from a process-wide allocator:
+// ::operator new by default, or the thread-local pool below, or any pair of functions installed with
+// set_allocator(). A vector remembers which allocator handed out its buffer and gives the buffer back to that
+// one, so the allocator can be switched at any time, also while vectors are alive.
+namespace small_vector_heap {
+
+struct allocator {
+  void* (*allocate)(size_t bytes);
+  void (*deallocate)(void* p, size_t bytes);
+};
+
+// Counters of the calling thread. Reset them by assigning {}
+struct stats {
+  uint64_t allocations;
+  uint64_t deallocations;
+  // allocations served from the pool's free lists
+  uint64_t reused;
+  uint64_t bytes;
+  // time spent allocating and freeing, only counted when built with BIG_INTEGER_ALLOCATION_TIMING
+  uint64_t nanoseconds;
+};
+
+inline stats& thread_stats() {
+  static thread_local stats s{};
+  return s;
+}
+
+constexpr size_t MIN_CLASS = 32;
+
+// the size class that holds `bytes`
+inline size_t size_class(size_t bytes) {
+  if (bytes <= MIN_CLASS) {
+    return MIN_CLASS;
+  }
+  // bytes lies in (2^k, 2^(k+1)], split into four steps of 2^(k-2)
+  size_t step = size_t(1) << (61 - __builtin_clzll(bytes - 1));
+  return (bytes + step - 1) & ~(step - 1);
+}
+
+inline void* new_block(size_t bytes) {
+  return ::operator new(bytes);
+}
+
+inline void delete_block(void* p, size_t) {
+  ::operator delete(p);
+}
+
+// Per-thread free lists of blocks up to POOL_MAX_BLOCK bytes, linked through the blocks themselves. Freeing
+// never takes a lock: a block goes to the list of the thread that frees it, whichever thread allocated it. Each
+// class caches up to POOL_CLASS_BYTES bytes, the rest is returned to ::operator delete. The lists are plain data
+// so that vectors destroyed after the thread's pool has been drained at exit still find it
+namespace pool {
+
+constexpr size_t POOL_MAX_BLOCK = size_t(64) << 10;
+constexpr size_t POOL_CLASS_BYTES = size_t(64) << 10;
+// classes 32, 40, 48, 56, 64, 80, ... up to POOL_MAX_BLOCK
+constexpr size_t CLASSES = 45;
+
+struct free_lists {
+  void* head[CLASSES];
+  uint32_t count[CLASSES];
+  bool drained;
+};
+
+inline free_lists& storage() {
+  static thread_local free_lists l{};
+  return l;
+}
+
+inline void drain() {
+  free_lists& l = storage();
+  for (size_t i = 0; i < CLASSES; i++) {
+    while (l.head[i] != nullptr) {
+      void* p = l.head[i];
+      l.head[i] = *static_cast<void**>(p);
+      ::operator delete(p);
+    }
+    l.count[i] = 0;
+  }
+}
+
+// frees the cached blocks when the thread exits
+struct drain_at_exit {
+  ~drain_at_exit() {
+    drain();
+    storage().drained = true;
+  }
+};
+
+// the calling thread's lists. Whatever the thread does first, allocating or freeing, arranges the drain
+inline free_lists& lists() {
+  static thread_local drain_at_exit registered;
+  (void) registered;
+  return storage();
+}
+
+// index of a size class not above POOL_MAX_BLOCK
+inline size_t class_index(size_t bytes) {
+  if (bytes == MIN_CLASS) {
+    return 0;
+  }
+  size_t k = 63 - __builtin_clzll(bytes - 1);
+  return 4 * (k - 5) + ((bytes - 1) >> (k - 2)) - 3;
+}
+
+inline void* allocate(size_t bytes) {
+  if (bytes <= POOL_MAX_BLOCK) {
+    free_lists& l = lists();
+    size_t i = class_index(bytes);
+    if (l.head[i] != nullptr) {
+      void* p = l.head[i];
+      l.head[i] = *static_cast<void**>(p);
+      l.count[i]--;
+      thread_stats().reused++;
+      return p;
+    }
+  }
+  return ::operator new(bytes);
+}
+
+inline void deallocate(void* p, size_t bytes) {
+  if (bytes <= POOL_MAX_BLOCK) {
+    free_lists& l = lists();
+    size_t i = class_index(bytes);
+    if (!l.drained && l.count[i] < std::max<size_t>(POOL_CLASS_BYTES / bytes, 2)) {
+      *static_cast<void**>(p) = l.head[i];
+      l.head[i] = p;
+      l.count[i]++;
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+} // namespace pool
+
+inline constexpr allocator system_allocator = {new_block, delete_block};
+inline constexpr allocator pool_allocator = {pool::allocate, pool::deallocate};
+
+// BIG_INTEGER_LIMB_POOL makes the pool the initial allocator
+#ifdef BIG_INTEGER_LIMB_POOL
+inline std::atomic<allocator const*> current{&pool_allocator};
+#else
+inline std::atomic<allocator const*> current{&system_allocator};
+#endif
+
+// Installs `a` for all threads. It must stay alive while any vector uses the heap. Whatever was written to set
+// `a` up before this call is visible to a thread that picks `a` up
+inline void set_allocator(allocator const& a) {
+  current.store(&a, std::memory_order_release);
+}
+
+inline allocator const& get_allocator() {
+  return *current.load(std::memory_order_acquire);
+}
+
+// allocates from the current allocator, which is stored in `owner` to free the block with
+inline void* allocate(size_t bytes, allocator const*& owner) {
+  stats& s = thread_stats();
+  s.allocations++;
+  s.bytes += bytes;
+  owner = &get_allocator();
+#ifdef BIG_INTEGER_ALLOCATION_TIMING
+  auto start = std::chrono::steady_clock::now();
+  void* p = owner->allocate(bytes);
+  s.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  return p;
+#else
+  return owner->allocate(bytes);
+#endif
+}
+
+inline void deallocate(void* p, size_t bytes, allocator const& owner) {
+  stats& s = thread_stats();
+  s.deallocations++;
+#ifdef BIG_INTEGER_ALLOCATION_TIMING
+  auto start = std::chrono::steady_clock::now();
+  owner.deallocate(p, bytes);
+  s.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#else
+  owner.deallocate(p, bytes);
+#endif
+}
+
+} // namespace small_vector_heap
+
+// Vector of trivially copyable elements that keeps up to N of them inside the object
+// and only spills to the heap when it grows beyond that.
+template<typename T, size_t N>
+struct small_vector {
+  static_assert(std::is_trivially_copyable<T>::value, "small_vector elements must be trivially copyable");
+  static_assert(N > 0, "small_vector needs a non-empty inline buffer");
+  static_assert(8 % sizeof(T) == 0, "small_vector heap size classes are multiples of 8 bytes");
+
+  // heap_ is set only so that compilers do not take the unused pointer for an uninitialized read
+  small_vector() : size_(0), capacity_(N), heap_{nullptr, nullptr} {}
+
+  explicit small_vector(size_t n, T const& value = T()) : small_vector() {
+    resize(n, value);
+  }
+
+  small_vector(T const* first, T const* last) : small_vector() {
+    assign(first, last);
+  }
+
+  small_vector(small_vector const& other) : small_vector(other.begin(), other.end()) {}
+
+  small_vector(small_vector&& other) noexcept : small_vector() {
+    steal(other);
+  }
+
+  ~small_vector() {
+    release();
+  }
+
+  small_vector& operator=(small_vector const& other) {
+    if (this != &other) {
+      assign(other.begin(), other.end());
+    }
+    return *this;
+  }
+
+  small_vector& operator=(small_vector&& other) noexcept {
+    if (this != &other) {
+      release();
+      steal(other);
+    }
+    return *this;
+  }
+
+  void assign(T const* first, T const* last) {
+    size_t n = last - first;
+    if (n > capacity_) {
+      // the source may live in our own buffer, so copy before releasing it
+      size_t capacity = n;
+      heap_block block = allocate(capacity);
+      std::memcpy(block.data, first, n * sizeof(T));
+      release();
+      heap_ = block;
+      capacity_ = capacity;
+    } else if (n != 0) {
+      std::memmove(data(), first, n * sizeof(T));
+    }
+    size_ = n;
+  }
+
+  T* data() {
+    return is_inline() ? inline_ : heap_.data;
+  }
+
+  T const* data() const {
+    return is_inline() ? inline_ : heap_.data;
+  }
+
+  T* begin() {
+    return data();
+  }
+
+  T const* begin() const {
+    return data();
+  }
+
+  T* end() {
+    return data() + size_;
+  }
+
+  T const* end() const {
+    return data() + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  T& operator[](size_t i) {
+    return data()[i];
+  }
+
+  T const& operator[](size_t i) const {
+    return data()[i];
+  }
+
+  T& back() {
+    return data()[size_ - 1];
+  }
+
+  T const& back() const {
+    return data()[size_ - 1];
+  }
+
+  void reserve(size_t n) {
+    if (n > capacity_) {
+      grow(n);
+    }
+  }
+
+  void resize(size_t n, T const& value = T()) {
+    if (n > capacity_) {
+      grow(std::max(n, 2 * capacity_));
+    }
+    if (n > size_) {
+      std::fill(data() + size_, data() + n, value);
+    }
+    size_ = n;
+  }
+
+  void push_back(T const& value) {
+    T copy = value;
+    if (size_ == capacity_) {
+      grow(2 * capacity_);
+    }
+    data()[size_++] = copy;
+  }
+
+  void pop_back() {
+    size_--;
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  friend bool operator==(small_vector const& a, small_vector const& b) {
+    return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin());
+  }
+
+  friend bool operator!=(small_vector const& a, small_vector const& b) {
+    return !(a == b);
+  }
+
+private:
+  struct heap_block {
+    T* data;
+    // the allocator that handed out data and takes it back
+    small_vector_heap::allocator const* owner;
+  };
+
+  size_t size_;
+  size_t capacity_;
+  union {
+    heap_block heap_;
+    T inline_[N];
+  };
+
+  bool is_inline() const {
+    return capacity_ == N;
+  }
+
+  // rounds n up to the capacity of the whole size class
+  static heap_block allocate(size_t& n) {
+    size_t bytes = small_vector_heap::size_class(n * sizeof(T));
+    n = bytes / sizeof(T);
+    heap_block block;
+    block.data = static_cast<T*>(small_vector_heap::allocate(bytes, block.owner));
+    return block;
+  }
+
+  void grow(size_t n) {
+    heap_block block = allocate(n);
+    if (size_ != 0) {
+      std::memcpy(block.data, data(), size_ * sizeof(T));
+    }
+    release();
+    heap_ = block;
+    capacity_ = n;
+  }
+
+  void release() {
+    if (!is_inline()) {
+      small_vector_heap::deallocate(heap_.data, capacity_ * sizeof(T), *heap_.owner);
+      capacity_ = N;
+    }
+  }
+
+  // takes over other's heap buffer, or copies its inline elements; leaves other empty
+  void steal(small_vector& other) {
+    size_ = other.size_;
+    if (other.is_inline()) {
+      std::memcpy(inline_, other.inline_, size_ * sizeof(T));
+    } else {
+      heap_ = other.heap_;
+      capacity_ = other.capacity_;
+      other.capacity_ = N;
+    }
+    other.size_ = 0;
+  }
+};
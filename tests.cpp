@@ -4,8 +4,12 @@
 #include <cstdlib>
 #include <limits>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "big_integer.h"
+#include "big_integer_expr.h"
 
 TEST(correctness, two_plus_two) {
   EXPECT_EQ(big_integer(4), big_integer(2) + big_integer(2));
@@ -61,6 +65,50 @@ TEST(correctness, ctor_invalid_string) {
   EXPECT_THROW(big_integer("++5"), std::invalid_argument);
 }
 
+TEST(correctness, copy_small_and_large) {
+  big_integer a = -7;
+  big_integer b = a << 1000;
+  big_integer c = b;
+  c >>= 1000;
+  b = a;
+  a = c << 2000;
+
+  EXPECT_EQ(-7, b);
+  EXPECT_EQ(-7, c);
+  EXPECT_EQ(c, a >> 2000);
+}
+
+TEST(correctness, move_ctor) {
+  big_integer a("-123456789012345678901234567890");
+  big_integer b = std::move(a);
+
+  EXPECT_EQ(big_integer("-123456789012345678901234567890"), b);
+  a = 5;
+  EXPECT_EQ(5, a);
+}
+
+TEST(correctness, move_assignment) {
+  big_integer a("123456789012345678901234567890");
+  big_integer b = 7;
+  b = std::move(a);
+
+  EXPECT_EQ(big_integer("123456789012345678901234567890"), b);
+  b = std::move(b);
+  EXPECT_EQ(big_integer("123456789012345678901234567890"), b);
+}
+
+TEST(correctness, rvalue_operands) {
+  big_integer a("100000000000000000000");
+  big_integer b("-300000000000000000000");
+
+  EXPECT_EQ(big_integer("-200000000000000000000"), a + (b + 0));
+  EXPECT_EQ(big_integer("-30000000000000000000000000000000000000000"), a * (b * 1));
+  EXPECT_EQ(a & b, a & (b | 0));
+  EXPECT_EQ(a | b, a | (b | 0));
+  EXPECT_EQ(a ^ b, a ^ (b | 0));
+  EXPECT_EQ(big_integer("400000000000000000000"), a - (b + 0));
+}
+
 TEST(correctness, assignment_operator) {
   big_integer a = 4;
   big_integer b = 7;
@@ -159,6 +207,25 @@ TEST(correctness, sub_signed) {
   EXPECT_TRUE(a == 85);
 }
 
+TEST(correctness, add_sub_long_carry) {
+  for (int bits : {31, 32, 63, 64, 65, 1000, 1024, 5003}) {
+    big_integer p = big_integer(1) << bits;
+    big_integer ones = p - 1;
+    big_integer x = ones;
+
+    EXPECT_EQ(p, ones + 1);
+    EXPECT_EQ(p, 1 + ones);
+    EXPECT_EQ(ones, p - 1);
+    EXPECT_EQ(-ones, 1 - p);
+    EXPECT_EQ(2 * p - 2, ones + ones);
+    x += x;
+    EXPECT_EQ(2 * ones, x);
+    x -= x;
+    EXPECT_EQ(0, x);
+    EXPECT_EQ(p + 5, (ones + 7) - 1);
+  }
+}
+
 TEST(correctness, sub_return_value) {
   big_integer a = 5;
   big_integer b = 1;
@@ -250,6 +317,77 @@ TEST(correctness, div_rounding_negative) {
   EXPECT_TRUE(c % d == -3);
 }
 
+TEST(correctness, divmod) {
+  for (int a : {23, -23, 5, -5, 0}) {
+    for (int b : {5, -5, 23, -23, 1}) {
+      std::pair<big_integer, big_integer> qr = divmod(a, b);
+      EXPECT_EQ(a / b, qr.first);
+      EXPECT_EQ(a % b, qr.second);
+    }
+  }
+
+  big_integer a("-100000000000000000000000000000000000000000000000000000000007");
+  big_integer b("30000000000000000000000000000");
+  big_integer q, r;
+  divmod(a, b, q, r);
+  EXPECT_EQ(a / b, q);
+  EXPECT_EQ(a % b, r);
+  EXPECT_EQ(a, q * b + r);
+
+  divmod(a, b, a, b);
+  EXPECT_EQ(q, a);
+  EXPECT_EQ(r, b);
+  EXPECT_THROW(divmod(a, 0), std::invalid_argument);
+}
+
+TEST(correctness, divmod_knuth) {
+  big_integer one = 1;
+  // B = 2^w is the limb base. With v = B^3 / 2 + 1 and u = (B - 1)(v - 1) the estimate from the top limbs is
+  // B - 1, one too large, so (B - 1) * v has to be added back; for the other limb width it is a plain division
+  for (int w : {32, 64}) {
+    big_integer base = one << w;
+    big_integer v = (one << (3 * w - 1)) + 1;
+    big_integer u = (base - 1) * (v - 1);
+    big_integer q, r;
+    divmod(u, v, q, r);
+    EXPECT_EQ(base - 2, q);
+    EXPECT_EQ(v - base + 1, r);
+
+    // the same step in the middle of a longer division
+    big_integer x = u * (one << (5 * w)) + 12345;
+    divmod(x, v, q, r);
+    EXPECT_EQ(x, q * v + r);
+    EXPECT_TRUE(r >= 0 && r < v);
+  }
+
+  // divisors whose top limb already has its top bit set need no normalizing shift
+  big_integer a = pow(big_integer(3), 700);
+  for (int n : {64, 96, 128, 192, 320}) {
+    for (big_integer b : {(one << n) - 1, (one << n) - 12345, (one << (n - 1)) + 1}) {
+      big_integer q0 = pow(big_integer(7), n / 8), r0 = b - 3;
+      big_integer q, r;
+      divmod(b * q0 + r0, b, q, r);
+      EXPECT_EQ(q0, q);
+      EXPECT_EQ(r0, r);
+      divmod(-(a * b), b, q, r);
+      EXPECT_EQ(-a, q);
+      EXPECT_EQ(0, r);
+    }
+  }
+
+  // repeated divisions into the same q and r reuse their buffers and the division workspace. The quotient is
+  // under a limb, so this stays in the Knuth kernel whatever the recursive division threshold is
+  big_integer b = pow(big_integer(5), 300) + 1, c = b * 12345 + 67, q, r;
+  divmod(c, b, q, r);
+  small_vector_heap::thread_stats() = {};
+  for (int i = 0; i < 10; i++) {
+    divmod(c, b, q, r);
+  }
+  EXPECT_EQ(0u, small_vector_heap::thread_stats().allocations);
+  EXPECT_EQ(12345, q);
+  EXPECT_EQ(67, r);
+}
+
 TEST(correctness, div_return_value) {
   big_integer a = 100;
   big_integer b = 2;
@@ -300,6 +438,65 @@ TEST(correctness, decrement) {
   EXPECT_EQ(41, post);
 }
 
+TEST(correctness, native_operands) {
+  big_integer one = 1;
+  big_integer a = (one << 256) - 1;
+  a += 1;
+  EXPECT_EQ(one << 256, a);
+  a -= 1u;
+  EXPECT_EQ((one << 256) - one, a);
+  EXPECT_EQ(-(one << 256), -a - 1ll);
+  EXPECT_EQ(2, 7 - big_integer(5));
+  EXPECT_EQ(-2, big_integer(5) - 7u);
+  EXPECT_EQ(-big_integer(5), -3 + big_integer(-2));
+
+  int64_t const min = std::numeric_limits<int64_t>::min();
+  uint64_t const max = std::numeric_limits<uint64_t>::max();
+  EXPECT_EQ(big_integer(min), big_integer(0) + min);
+  EXPECT_EQ(big_integer(max), big_integer(0) - min - min - 1);
+  EXPECT_EQ(a * big_integer(max), a * max);
+  EXPECT_EQ(a * big_integer(max), min * (a * 2) / 2 * max / min);
+  EXPECT_EQ(a / big_integer(max), a / max);
+  EXPECT_EQ(a % big_integer(max), a % max);
+  EXPECT_EQ(-a / big_integer(min), -a / min);
+  EXPECT_EQ(-a % big_integer(min), -a % min);
+  EXPECT_EQ(-(a / 1000000007), -a / 1000000007);
+  EXPECT_EQ(-(a % 1000000007), -a % 1000000007);
+  EXPECT_EQ(0, big_integer(0) * -5);
+  EXPECT_THROW(a / 0, std::invalid_argument);
+  EXPECT_THROW(a % 0u, std::invalid_argument);
+
+  EXPECT_TRUE(big_integer(max) == max);
+  EXPECT_TRUE(big_integer(-1) != max);
+  EXPECT_TRUE(big_integer(min) < min + 1);
+  EXPECT_TRUE(min < big_integer(min) + 1);
+  EXPECT_TRUE(-1 < big_integer(0));
+  EXPECT_TRUE(big_integer(0) > -1);
+  EXPECT_TRUE(a >= max && max <= a && a > 0u && 0u < a);
+  EXPECT_FALSE(big_integer(-5) >= 0);
+  EXPECT_FALSE(0 <= big_integer(-5));
+
+  // native and converted operands agree across sizes and signs
+  std::vector<int64_t> values = {0, 1, -1, 2, 1000000007, -4294967296, 4294967295, min, min + 1,
+                                 std::numeric_limits<int64_t>::max()};
+  for (big_integer x : {big_integer(0), big_integer(-3), a, -a, big_integer(min), big_integer(max)}) {
+    for (int64_t v : values) {
+      big_integer b = v;
+      EXPECT_EQ(x + b, x + v);
+      EXPECT_EQ(x - b, x - v);
+      EXPECT_EQ(b - x, v - x);
+      EXPECT_EQ(x * b, x * v);
+      if (v != 0) {
+        EXPECT_EQ(x / b, x / v);
+        EXPECT_EQ(x % b, x % v);
+      }
+      EXPECT_EQ(x < b, x < v);
+      EXPECT_EQ(x == b, x == v);
+      EXPECT_EQ(b < x, v < x);
+    }
+  }
+}
+
 TEST(correctness, and_) {
   big_integer a = 0x55;
   big_integer b = 0xaa;
@@ -389,6 +586,43 @@ TEST(correctness, xor_signed) {
   EXPECT_TRUE((a ^ (b - 256)) == (0x66 - 256));
 }
 
+TEST(correctness, bitwise_long) {
+  big_integer a = (big_integer(1) << 3000) - 12345;
+  big_integer b = -((big_integer(7) << 700) + 1);
+
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(a + b, (a & b) + (a | b));
+    EXPECT_EQ(a ^ b, (a | b) - (a & b));
+    EXPECT_EQ(b ^ a, (b | a) - (b & a));
+    a = -a;
+    if (i == 1) {
+      std::swap(a, b);
+    }
+  }
+
+  big_integer c = a;
+  c &= c;
+  EXPECT_EQ(a, c);
+  c |= c;
+  EXPECT_EQ(a, c);
+  c ^= c;
+  EXPECT_EQ(0, c);
+}
+
+TEST(correctness, bitwise_negative_limb_boundary) {
+  big_integer a = -(big_integer(1) << 63);
+  big_integer b = big_integer(1) << 63;
+
+  EXPECT_EQ(-(big_integer(1) << 64), a ^ b);
+  EXPECT_EQ(b, a & -a);
+  EXPECT_EQ(-1, (a - 1) | a);
+  EXPECT_EQ(-(big_integer(1) << 64), (a - 1) & (a << 1));
+  EXPECT_EQ(-1, a >> 100);
+  EXPECT_EQ(-2, (a - 1) >> 63);
+  EXPECT_EQ(-1, a >> 63);
+  EXPECT_EQ(b - 1, ~a);
+}
+
 TEST(correctness, xor_return_value) {
   big_integer a = 1;
 
@@ -403,6 +637,57 @@ TEST(correctness, not_) {
   EXPECT_TRUE(~a == (-a - 1));
 }
 
+TEST(correctness, expressions) {
+  using big_integer_expr::lazy;
+  big_integer a = big_integer(1) << 200, b = -(big_integer(3) << 150), c = 12345, d = -7, e = (a << 100) + 1;
+
+  big_integer r = lazy(a) * b + lazy(c) * d - e;
+  EXPECT_EQ(a * b + c * d - e, r);
+  r = lazy(a) - a;
+  EXPECT_EQ(0, r);
+  r = -(lazy(a) + b) + c - lazy(d) * d;
+  EXPECT_EQ(-(a + b) + c - d * d, r);
+  // factors that are sums or longer products are evaluated first
+  r = (lazy(a) + b) * (lazy(c) - d) * e;
+  EXPECT_EQ((a + b) * (c - d) * e, r);
+  // many terms of the same sign carry past the longest one
+  r = lazy(e) + e + e + e + e + e + e + e + e;
+  EXPECT_EQ(e * 9, r);
+  r = -lazy(e) - e - e - e - e - e - e - e - e;
+  EXPECT_EQ(e * -9, r);
+
+  // operands spanning several blocks of the accumulation, with carries and borrows running across them
+  big_integer x = (big_integer(1) << 40000) - 1, y = -((big_integer(1) << 25000) - 1), z = big_integer(1) << 12345;
+  r = lazy(x) + x + y - z + lazy(y) * z - lazy(x) * x;
+  EXPECT_EQ(x + x + y - z + y * z - x * x, r);
+  r = lazy(y) - x + z + 1;
+  EXPECT_EQ(y - x + z + 1, r);
+  r = lazy(x) * x - (x << 40000) + (x << 1) + 1;
+  EXPECT_EQ(x + 1, r);
+
+  // the destination may appear on the right
+  big_integer s = a;
+  s = lazy(s) * s + s - b;
+  EXPECT_EQ(a * a + a - b, s);
+  s = lazy(s) - s * s;
+  big_integer t = a * a + a - b;
+  EXPECT_EQ(t - t * t, s);
+  // and be the widest operand, behind narrower ones
+  big_integer small_a = 3, small_b = -5, wide = (big_integer(1) << 1000) + 1;
+  s = wide;
+  s = lazy(small_a) * small_b + s;
+  EXPECT_EQ(wide - 15, s);
+  s = wide;
+  s = lazy(small_a) - s;
+  EXPECT_EQ(3 - wide, s);
+  s = wide;
+  s = lazy(small_b) + small_a - s + s + s;
+  EXPECT_EQ(wide - 2, s);
+  s = -x;
+  s = lazy(z) * small_a + y - s;
+  EXPECT_EQ(z * 3 + y + x, s);
+}
+
 TEST(correctness, shl_) {
   big_integer a = 23;
 
@@ -412,6 +697,15 @@ TEST(correctness, shl_) {
   EXPECT_TRUE(a == 23 * 32);
 }
 
+TEST(correctness, shl_whole_limbs) {
+  big_integer a = 5;
+
+  EXPECT_EQ(big_integer("21474836480"), a << 32);
+  EXPECT_EQ(big_integer("92233720368547758080"), a << 64);
+  EXPECT_EQ(a, (a << 64) >> 64);
+  EXPECT_EQ(-a, (-a << 128) >> 128);
+}
+
 TEST(correctness, shl_return_value) {
   big_integer a = 1;
 
@@ -455,6 +749,30 @@ TEST(correctness, shr_return_value) {
   EXPECT_EQ(8, a);
 }
 
+TEST(correctness, shift_counts) {
+  big_integer a = 23;
+
+  EXPECT_EQ(a << 3, a >> -3);
+  EXPECT_EQ(a >> 3, a << -3);
+  EXPECT_EQ(-3, big_integer(-23) << -3);
+  EXPECT_EQ(a << 100, a << size_t(100));
+  EXPECT_EQ(a << 100, a << uint64_t(100));
+  EXPECT_EQ(0, a >> (uint64_t(1) << 40));
+  EXPECT_EQ(-1, -a >> (uint64_t(1) << 40));
+  EXPECT_EQ(-1, -a >> std::numeric_limits<uint64_t>::max());
+  EXPECT_EQ(0, a << std::numeric_limits<int64_t>::min());
+
+  // repeated shifts in place keep the value intact
+  big_integer b = (big_integer(1) << 1000) - 1;
+  for (int i = 0; i < 100; i++) {
+    b <<= 37 + i;
+  }
+  for (int i = 100; i-- > 0; ) {
+    b >>= 37 + i;
+  }
+  EXPECT_EQ((big_integer(1) << 1000) - 1, b);
+}
+
 TEST(correctness, add_long) {
   big_integer a("10000000000000000000000000000000000000000000000000000000000000"
                 "000000000000000000000000000000");
@@ -551,6 +869,104 @@ TEST(correctness, mul_long_pow2) {
   EXPECT_EQ(c, b * b);
 }
 
+TEST(correctness, mul_zero) {
+  big_integer a("-100000000000000000000000000");
+
+  EXPECT_EQ(0, a * 0);
+  EXPECT_EQ(0, 0 * a);
+}
+
+TEST(correctness, mul_huge) {
+  // (2^n - 1)^2 = 2^2n - 2^(n + 1) + 1, large enough to reach every multiplication tier
+  for (int n : {1001, 5003, 20011, 100003}) {
+    big_integer a = (big_integer(1) << n) - 1;
+    big_integer b = (big_integer(1) << (2 * n)) - (big_integer(1) << (n + 1)) + 1;
+
+    EXPECT_EQ(b, a * a);
+    EXPECT_EQ(-b, a * -a);
+    EXPECT_EQ(a * (a + 1), (a + 1) * a);
+  }
+}
+
+TEST(correctness, square) {
+  // powers of 3 give irregular limbs; sizes straddle the basecase, Karatsuba and Toom-3 squaring,
+  // and the shifted variants make the low half smaller than the high one
+  big_integer p = 3;
+  for (int n : {1, 2, 3, 7, 31, 47, 48, 49, 95, 160, 161, 500, 1700, 6001}) {
+    big_integer a = p;
+    for (int i = 1; i < n; i++) {
+      a *= 3;
+    }
+    for (big_integer x : {a, -a, (a << 3001) + 1, a * ((big_integer(1) << 3001) - 1)}) {
+      big_integer expected = x * (x + 1) - x;
+      big_integer y = x;
+
+      EXPECT_EQ(expected, square(x));
+      EXPECT_EQ(expected, x * x);
+      y *= y;
+      EXPECT_EQ(expected, y);
+    }
+  }
+  EXPECT_EQ(0, square(0));
+}
+
+TEST(correctness, addmul) {
+  // both signs of the accumulator and the product, with the sum crossing zero, for basecase and larger products
+  big_integer one = 1;
+  std::vector<big_integer> values = {0, 1, -1, 12345, (one << 100) - 1, -(one << 100), pow(big_integer(3), 400),
+                                     -pow(big_integer(7), 900) + 1};
+  for (big_integer const& acc : values) {
+    for (big_integer const& a : values) {
+      for (big_integer const& b : values) {
+        big_integer x = acc, y = acc;
+        addmul(x, a, b);
+        submul(y, a, b);
+        EXPECT_EQ(acc + a * b, x);
+        EXPECT_EQ(acc - a * b, y);
+      }
+    }
+  }
+  big_integer a = pow(big_integer(3), 1000), x = a * a + 1;
+  submul(x, a, a);
+  EXPECT_EQ(1, x);
+  submul(x, a, -a);
+  EXPECT_EQ(a * a + 1, x);
+
+  // native multipliers
+  int64_t const min = std::numeric_limits<int64_t>::min();
+  uint64_t const max = std::numeric_limits<uint64_t>::max();
+  for (big_integer const& acc : values) {
+    big_integer x = acc, y = acc;
+    addmul(x, a, max);
+    submul(y, a, min);
+    EXPECT_EQ(acc + a * big_integer(max), x);
+    EXPECT_EQ(acc - a * big_integer(min), y);
+    addmul(x, -a, 7);
+    submul(y, a, -1);
+    EXPECT_EQ(acc + a * big_integer(max) - a * 7, x);
+    EXPECT_EQ(acc - a * big_integer(min) + a, y);
+  }
+
+  // the accumulator may be an operand
+  x = a;
+  addmul(x, x, x);
+  EXPECT_EQ(a + a * a, x);
+  x = a;
+  submul(x, x, 3);
+  EXPECT_EQ(-2 * a, x);
+}
+
+TEST(correctness, mul_ntt) {
+  // (2^n - 1)(2^m - 1) = 2^(n + m) - 2^n - 2^m + 1, all-ones limbs maximize the convolution coefficients
+  int n = 4000037, m = 5000011;
+  big_integer a = (big_integer(1) << n) - 1;
+  big_integer b = (big_integer(1) << m) - 1;
+  big_integer c = (big_integer(1) << (n + m)) - (big_integer(1) << n) - (big_integer(1) << m) + 1;
+
+  EXPECT_EQ(c, a * b);
+  EXPECT_EQ((big_integer(1) << (2 * n)) - (big_integer(1) << (n + 1)) + 1, a * a);
+}
+
 TEST(correctness, div_0_long) {
   big_integer a;
   big_integer b("100000000000000000000000000000000000000000000000000000000000");
@@ -584,6 +1000,23 @@ TEST(correctness, div_long_signed2) {
   EXPECT_EQ(c, a / b);
 }
 
+TEST(correctness, div_huge) {
+  // divisors long enough for the recursive division, quotients shorter, equal to and longer than them
+  big_integer b = (big_integer(1) << 20011) / 3 + 7;
+  for (int n : {3001, 20011, 50021}) {
+    big_integer a = (big_integer(1) << n) / 7 + 11;
+    big_integer c = b / 5 + 3;
+    big_integer ab = a * b + c;
+
+    EXPECT_EQ(a, ab / b);
+    EXPECT_EQ(c, ab % b);
+    EXPECT_EQ(-a, -ab / b);
+    EXPECT_EQ(-c, -ab % b);
+    EXPECT_EQ(b + c / a, ab / a);
+    EXPECT_EQ(c % a, ab % a);
+  }
+}
+
 TEST(correctness, negation_long) {
   big_integer a("10000000000000000000000000000000000000000000000000000");
   big_integer c("-10000000000000000000000000000000000000000000000000000");
@@ -650,6 +1083,38 @@ TEST(correctness, string_conv) {
   EXPECT_EQ("-2147483649", to_string(lim));
 }
 
+TEST(correctness, string_parse_long) {
+  std::string nines(5000, '9');
+  big_integer a(nines);
+
+  EXPECT_EQ(big_integer("1" + std::string(5000, '0')), a + 1);
+  EXPECT_EQ(big_integer("-" + nines), -a);
+  EXPECT_EQ(a, big_integer(std::string(777, '0') + nines));
+  EXPECT_EQ(0, big_integer(std::string(1000, '0')));
+  EXPECT_EQ(0, big_integer("-" + std::string(1000, '0')));
+  EXPECT_THROW(big_integer(nines + "x" + nines), std::invalid_argument);
+  EXPECT_THROW(big_integer(nines + "-"), std::invalid_argument);
+}
+
+TEST(correctness, string_conv_long) {
+  big_integer pow10 = 1;
+  for (size_t n = 1; n <= 3000; n++) {
+    pow10 *= 10;
+    if (n % 97 == 0 || n % 9 == 0) {
+      EXPECT_EQ("1" + std::string(n, '0'), to_string(pow10));
+      EXPECT_EQ(std::string(n, '9'), to_string(pow10 - 1));
+      EXPECT_EQ("-1" + std::string(n - 1, '0') + "1", to_string(-pow10 - 1));
+    }
+  }
+
+  std::string digits = "1";
+  for (size_t i = 0; i < 20000; i++) {
+    digits.push_back(char('0' + (i * 7 + i / 13) % 10));
+  }
+  EXPECT_EQ(digits, to_string(big_integer(digits)));
+  EXPECT_EQ("-" + digits, to_string(big_integer("-" + digits)));
+}
+
 namespace {
 template <typename T>
 void test_converting_ctor(T value) {
@@ -714,3 +1179,369 @@ TEST(correctness, converting_ctor4) {
 
   EXPECT_EQ(to_string(bignum), std::to_string(num));
 }
+
+TEST(correctness, converting_ctor5) {
+  EXPECT_EQ("4294967296", to_string(big_integer(1ULL << 32)));
+  EXPECT_EQ("-4294967296", to_string(big_integer(-(1LL << 32))));
+  EXPECT_EQ("18446744069414584320", to_string(big_integer(0xFFFFFFFF00000000ULL)));
+}
+
+TEST(correctness, pow) {
+  EXPECT_EQ(big_integer(1) << 100, pow(2, 100));
+  EXPECT_EQ(-27, pow(-3, 3));
+  EXPECT_EQ(81, pow(-3, 4));
+  EXPECT_EQ(1, pow(0, 0));
+  EXPECT_EQ(0, pow(0, 5));
+  EXPECT_EQ(1, pow(-1, 1000000));
+
+  big_integer a("-123456789012345678901234567890"), expected = 1;
+  for (unsigned e = 0; e < 70; e++) {
+    EXPECT_EQ(expected, pow(a, e));
+    expected *= a;
+  }
+}
+
+TEST(correctness, isqrt) {
+  for (int i = 0; i < 200; i++) {
+    int r = 0;
+    while ((r + 1) * (r + 1) <= i) r++;
+    EXPECT_EQ(r, isqrt(i));
+  }
+  for (int bits : {60, 64, 100, 1000, 10007}) {
+    big_integer x = (big_integer(1) << bits) / 3 + 5;
+    big_integer sq = x * x;
+    EXPECT_EQ(x, isqrt(sq));
+    EXPECT_EQ(x - 1, isqrt(sq - 1));
+    EXPECT_EQ(x, isqrt(sq + 2 * x));
+    EXPECT_EQ(x + 1, isqrt(sq + 2 * x + 1));
+  }
+  EXPECT_THROW(isqrt(-1), std::invalid_argument);
+}
+
+TEST(correctness, iroot) {
+  EXPECT_EQ(-3, iroot(-27, 3));
+  EXPECT_EQ(-3, iroot(-28, 3));
+  EXPECT_EQ(2, iroot(26, 3));
+  EXPECT_EQ(1, iroot(5, 100));
+  EXPECT_EQ(2, iroot(big_integer(1) << 2000, 2000));
+  EXPECT_EQ(1, iroot((big_integer(1) << 2000) - 1, 2000));
+  EXPECT_EQ(-12345, iroot(-12345, 1));
+
+  big_integer x = pow(3, 500) + 7;
+  for (unsigned k : {2, 3, 5, 17, 64}) {
+    big_integer p = pow(x, k);
+    EXPECT_EQ(x, iroot(p, k));
+    EXPECT_EQ(x - 1, iroot(p - 1, k));
+    EXPECT_EQ(x, iroot(p + 1, k));
+    if (k % 2 == 1) {
+      EXPECT_EQ(-x, iroot(-p, k));
+      EXPECT_EQ(-x, iroot(-p - 1, k));
+    }
+  }
+  EXPECT_THROW(iroot(8, 0), std::invalid_argument);
+  EXPECT_THROW(iroot(-16, 4), std::invalid_argument);
+}
+
+TEST(correctness, gcd) {
+  EXPECT_EQ(0, gcd(0, 0));
+  EXPECT_EQ(7, gcd(0, -7));
+  EXPECT_EQ(6, gcd(-12, 18));
+  EXPECT_EQ(1, gcd(17, 5));
+
+  // consecutive Fibonacci numbers are the worst case for Euclid, every quotient is 1
+  big_integer f0 = 0, f1 = 1;
+  for (int i = 0; i < 3000; i++) {
+    f0 += f1;
+    std::swap(f0, f1);
+  }
+  EXPECT_EQ(1, gcd(f0, f1));
+
+  big_integer p = (big_integer(1) << 521) - 1, q = (big_integer(1) << 607) - 1;
+  big_integer c = pow(big_integer(3), 700);
+  EXPECT_EQ(c, gcd(c * p, c * q));
+  EXPECT_EQ(c, gcd(-c * q, c * p));
+  EXPECT_EQ(c * 2, gcd(c * 2, (c * 2) << 5000));
+  EXPECT_EQ(c * p, gcd(c * p * q * q, c * p * (q + 2)));
+}
+
+TEST(correctness, extended_gcd) {
+  big_integer f0 = 0, f1 = 1;
+  for (int i = 0; i < 1000; i++) {
+    f0 += f1;
+    std::swap(f0, f1);
+  }
+  big_integer c = pow(big_integer(7), 300);
+  for (std::pair<big_integer, big_integer> const& ab : std::vector<std::pair<big_integer, big_integer>>{
+           {0, 0}, {5, 0}, {0, -5}, {240, 46}, {-240, 46}, {46, -240}, {f1, f0}, {f0, -f1},
+           {c * 12345, c * 6789}, {c << 3000, c * 3}}) {
+    big_integer a = ab.first, b = ab.second, g, x, y;
+    extended_gcd(a, b, g, x, y);
+    EXPECT_EQ(gcd(a, b), g);
+    EXPECT_EQ(g, a * x + b * y);
+  }
+
+  // outputs aliasing the inputs
+  big_integer a = 240, b = 46, y;
+  extended_gcd(a, b, a, b, y);
+  EXPECT_EQ(2, a);
+  EXPECT_EQ(2, 240 * b + 46 * y);
+}
+
+TEST(correctness, mod_inverse) {
+  EXPECT_EQ(4, mod_inverse(3, 11));
+  EXPECT_EQ(7, mod_inverse(-3, 11));
+  EXPECT_EQ(4, mod_inverse(3, -11));
+  EXPECT_EQ(0, mod_inverse(5, 1));
+
+  big_integer m = (big_integer(1) << 1279) - 1;
+  for (big_integer a : {big_integer(2), pow(big_integer(3), 1000), -(big_integer(1) << 1000) - 12345}) {
+    big_integer inv = mod_inverse(a, m);
+    EXPECT_TRUE(inv >= 0 && inv < m);
+    EXPECT_EQ(1, (a * inv % m + m) % m);
+  }
+  EXPECT_THROW(mod_inverse(6, 9), std::invalid_argument);
+  EXPECT_THROW(mod_inverse(0, 9), std::invalid_argument);
+  EXPECT_THROW(mod_inverse(3, 0), std::invalid_argument);
+}
+
+TEST(correctness, is_probable_prime) {
+  // against trial division across the table, trial division and Baillie-PSW ranges
+  auto is_prime = [](uint64_t n) {
+    for (uint64_t p = 2; p * p <= n; p++) {
+      if (n % p == 0) {
+        return false;
+      }
+    }
+    return n >= 2;
+  };
+  for (uint64_t from : {uint64_t(0), uint64_t(65000), uint64_t(1) << 20, (uint64_t(1) << 32) - 500}) {
+    for (uint64_t n = from; n < from + 1000; n++) {
+      EXPECT_EQ(is_prime(n), is_probable_prime(n)) << n;
+    }
+  }
+  EXPECT_FALSE(is_probable_prime(-7));
+
+  big_integer one = 1;
+  EXPECT_TRUE(is_probable_prime((one << 521) - 1));
+  EXPECT_TRUE(is_probable_prime((one << 4423) - 1, 5));
+  EXPECT_FALSE(is_probable_prime((one << 523) - 1));
+  EXPECT_FALSE(is_probable_prime(((one << 521) - 1) * ((one << 521) - 1)));
+  // a Carmichael number and strong pseudoprimes to base 2 without small factors
+  EXPECT_FALSE(is_probable_prime(big_integer(9624742921)));
+  EXPECT_FALSE(is_probable_prime(25326001));
+  EXPECT_FALSE(is_probable_prime(big_integer(3825123056546413051)));
+  // a square of a Wieferich prime passes the Miller-Rabin test to base 2
+  EXPECT_FALSE(is_probable_prime(3511 * 3511));
+}
+
+TEST(correctness, next_prime) {
+  EXPECT_EQ(2, next_prime(-5));
+  EXPECT_EQ(3, next_prime(2));
+  EXPECT_EQ(65537, next_prime(65521));
+  EXPECT_EQ(65537, next_prime(65535));
+
+  big_integer one = 1;
+  EXPECT_EQ((one << 64) + 13, next_prime(one << 64));
+  EXPECT_EQ((one << 128) + 51, next_prime(one << 128));
+  EXPECT_EQ((one << 1000) + 297, next_prime(one << 1000));
+  EXPECT_EQ(pow(big_integer(10), 100) + 267, next_prime(pow(big_integer(10), 100)));
+}
+
+TEST(correctness, pow_mod) {
+  EXPECT_EQ(24, pow_mod(2, 10, 1000));
+  EXPECT_EQ(1, pow_mod(3, 0, 7));
+  EXPECT_EQ(0, pow_mod(5, 100, 1));
+  EXPECT_EQ(2, pow_mod(-2, 3, 5));
+  EXPECT_EQ(3, pow_mod(2, 3, -5));
+  EXPECT_EQ(0, pow_mod(0, 5, 12));
+
+  // Fermat's little theorem for the Mersenne primes 2^521 - 1 and 2^4423 - 1
+  for (int p : {521, 4423}) {
+    big_integer m = (big_integer(1) << p) - 1;
+    EXPECT_EQ(1, pow_mod(3, m - 1, m));
+    EXPECT_EQ(12345, pow_mod(12345, m, m));
+    EXPECT_EQ(1, montgomery_context(m).pow_mod(-7, m - 1));
+  }
+
+  // against repeated multiplication, for an odd and an even modulus
+  big_integer a("987654321987654321987654321987654321987654321");
+  for (big_integer m : {(big_integer(1) << 700) + 111, (big_integer(1) << 700) + 222}) {
+    big_integer expected = 1;
+    for (int e = 1; e <= 300; e++) {
+      expected = expected * a % m;
+      if (e % 37 == 0 || e == 300) {
+        EXPECT_EQ(expected, pow_mod(a, e, m));
+      }
+    }
+  }
+}
+
+TEST(correctness, montgomery_context) {
+  big_integer m = (big_integer(1) << 1000) - 1 + (big_integer(1) << 500);
+  montgomery_context ctx(m);
+  big_integer a = (big_integer(1) << 999) + 12345, b = -(big_integer(1) << 1500) - 1;
+
+  EXPECT_EQ(m, ctx.modulus());
+  EXPECT_EQ(a * a % m, ctx.mul_mod(a, a));
+  EXPECT_EQ((a * b % m + m) % m, ctx.mul_mod(a, b));
+  EXPECT_EQ(0, ctx.mul_mod(m, b));
+  EXPECT_EQ(ctx.mul_mod(a, ctx.mul_mod(a, a)), ctx.pow_mod(a, 3));
+
+  EXPECT_THROW(montgomery_context(m + 1), std::invalid_argument);
+  EXPECT_THROW(montgomery_context(0), std::invalid_argument);
+  EXPECT_THROW(pow_mod(2, 3, 0), std::invalid_argument);
+  EXPECT_THROW(pow_mod(2, -3, 7), std::invalid_argument);
+  EXPECT_THROW(pow_mod(2, -3, 8), std::invalid_argument);
+}
+
+TEST(correctness, modulus) {
+  // single limb, Knuth and Barrett sized moduli, each against dividends of several blocks
+  big_integer x("-31415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421");
+  for (big_integer m : {big_integer(97), big_integer(-1000000007), (big_integer(3) << 200) + 1,
+                        (big_integer(1) << 2500) - 3, (big_integer(5) << 5000) + 12345}) {
+    modulus mod(m);
+    big_integer am = m < 0 ? -m : m;
+    EXPECT_EQ(am, mod.value());
+    EXPECT_EQ(0, mod.reduce(0));
+    EXPECT_EQ(0, mod.reduce(m));
+    EXPECT_EQ(1, mod.reduce(m + 1));
+    EXPECT_EQ(am - 1, mod.reduce(-1));
+
+    big_integer a = x;
+    for (int i = 0; i < 6; i++) {
+      big_integer expected = (a % am + am) % am;
+      EXPECT_EQ(expected, mod.reduce(a));
+      EXPECT_EQ(expected, mod.reduce(a + am * 7));
+      EXPECT_EQ((a * x % am + am) % am, mod.mul_mod(a, x));
+      EXPECT_EQ(a * a % am, mod.mul_mod(a, a));
+      EXPECT_EQ(((a + x) % am + am) % am, mod.add_mod(a, x));
+      big_integer r = mod.reduce(a), s = mod.reduce(x);
+      EXPECT_EQ((r + s) % am, mod.add_mod(r, s));
+      EXPECT_EQ(mod.reduce(square(a)), mod.mul_mod(r, r));
+      a = a * a * 3 + 1;
+    }
+  }
+  EXPECT_THROW(modulus(0), std::invalid_argument);
+}
+
+TEST(correctness, kernels_agree) {
+  std::string initial = big_integer_kernels::current();
+  std::vector<std::string> names = big_integer_kernels::available();
+  ASSERT_FALSE(names.empty());
+  EXPECT_EQ("portable", names[0]);
+  EXPECT_FALSE(big_integer_kernels::select("no such kernels"));
+  EXPECT_EQ(initial, big_integer_kernels::current());
+
+  auto run = [] {
+    std::vector<big_integer> results;
+    big_integer a = (big_integer(1) << 4099) / 3 + 12345;
+    big_integer b = -((big_integer(1) << 2053) / 7 + 1);
+    for (int n : {1, 2, 3, 5, 17, 40, 129}) {
+      big_integer x = (a >> (n * 31)) - n;
+      results.push_back(a + x);
+      results.push_back(x - a);
+      results.push_back(x * b);
+      results.push_back(a * x);
+      results.push_back(a / x);
+      results.push_back(b % x);
+      results.push_back(x << n);
+      results.push_back(b >> n);
+      results.push_back(a & x);
+      results.push_back(a | x);
+      results.push_back(a ^ x);
+      results.push_back(big_integer(to_string(x * x)));
+    }
+    return results;
+  };
+
+  ASSERT_TRUE(big_integer_kernels::select("portable"));
+  std::vector<big_integer> expected = run();
+  for (std::string const& name : names) {
+    ASSERT_TRUE(big_integer_kernels::select(name));
+    EXPECT_EQ(name, big_integer_kernels::current());
+    EXPECT_TRUE(expected == run()) << name;
+  }
+  big_integer_kernels::select(initial);
+}
+
+namespace {
+// malloc-based, so that the sanitizers catch one of its blocks going to ::operator delete or the other way round
+size_t malloc_blocks = 0;
+
+void* malloc_allocate(size_t bytes) {
+  malloc_blocks++;
+  return std::malloc(bytes);
+}
+
+void malloc_deallocate(void* p, size_t) {
+  malloc_blocks--;
+  std::free(p);
+}
+
+small_vector_heap::allocator const malloc_allocator = {malloc_allocate, malloc_deallocate};
+} // namespace
+
+TEST(correctness, limb_pool) {
+  namespace heap = small_vector_heap;
+  heap::allocator const& initial = heap::get_allocator();
+  // vectors outlive the allocator that was installed when they grew, and free through that one
+  big_integer a = pow(big_integer(3), 5000);
+  heap::set_allocator(heap::system_allocator);
+  big_integer b = a * a;
+  heap::set_allocator(heap::pool_allocator);
+  big_integer c = b / a;
+  b = 0;
+
+  heap::thread_stats() = {};
+  auto run = [&a] {
+    std::vector<big_integer> results;
+    big_integer x = a;
+    for (int i = 0; i < 20; i++) {
+      x = (x * x - a) / (a + i) + x % 1000003;
+      results.push_back(to_string(x).size());
+      results.push_back(x);
+    }
+    return results;
+  };
+  std::vector<big_integer> pooled = run();
+  heap::stats s = heap::thread_stats();
+  // the big results and the library's per-thread scratch buffers are still alive
+  EXPECT_GE(s.allocations, s.deallocations + pooled.size() / 2);
+  EXPECT_GT(s.reused, 0u);
+  EXPECT_LE(s.reused, s.allocations);
+
+  // blocks allocated in another thread go to this thread's pool
+  big_integer d;
+  std::thread([&d, &a] { d = a * 7; }).join();
+  d = 0;
+  // a thread that only frees keeps what it frees until it exits, the leak checker sees if it is not returned
+  std::vector<big_integer> values(100, a);
+  std::thread([&values] { values.clear(); }).join();
+
+  uint64_t reused = heap::thread_stats().reused;
+  heap::set_allocator(heap::system_allocator);
+  EXPECT_TRUE(pooled == run());
+  EXPECT_EQ(a, c);
+  EXPECT_EQ(reused, heap::thread_stats().reused);
+
+  // a custom allocator only gets back its own blocks
+  big_integer pooled_value;
+  heap::set_allocator(heap::pool_allocator);
+  pooled_value = a * 3;
+  heap::set_allocator(malloc_allocator);
+  big_integer e = a * 5, f = a * 7;
+  EXPECT_EQ(2u, malloc_blocks);
+  heap::set_allocator(heap::system_allocator);
+  e = 0;
+  EXPECT_EQ(1u, malloc_blocks);
+  f = pooled_value;
+  EXPECT_EQ(1u, malloc_blocks);
+  heap::set_allocator(malloc_allocator);
+  pooled_value = 0;
+  f = a * 11;
+  EXPECT_EQ(1u, malloc_blocks);
+  EXPECT_EQ(a * 11, f);
+  f = 0;
+  EXPECT_EQ(0u, malloc_blocks);
+  heap::set_allocator(initial);
+}